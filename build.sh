@@ -6,25 +6,43 @@ dirbuild="$PWD/buildout"
 dirbuildexe="$dirbuild/exe"
 dirsrc="$PWD/src"
 fileterminfo="$dirsrc/$appname.terminalinfo"
+filebenchbaseline="$PWD/bench.baseline" # of this machine, not in git
 #end configs
 
 source "$PWD/build_scripts/_.functions.sh"
 
+# terminal core library, shared by the executable and the benchmark
+fn_makecore() {
+	printf "\n"
+	fn_echobold "Creating terminal core library from ${appname}_term.c"
+	cmd="cc -c -g -std=c99 -pedantic -Wall -Wvariadic-macros -Werror -Os -I. -D_XOPEN_SOURCE=600 $dirsrc/${appname}_term.c -o $dirbuildexe/${appname}_term.o"
+	echo $cmd
+	$cmd
+	fn_stoponerror "$?" $LINENO
+	cmd="ar rcs $dirbuildexe/lib${appname}_term.a $dirbuildexe/${appname}_term.o"
+	echo $cmd
+	$cmd
+	fn_stoponerror "$?" $LINENO
+	rm -rf "$dirbuildexe/${appname}_term.o"
+}
+
 
 
 if [ "$1" = "--make" ] || [ "$1" = "make" ]; then
 
     fn_dirEnsureClear "$dirbuildexe"
+	fn_makecore
+
 	printf "\n"
 	fn_echobold "Creating obj file from $appname.c"
-	cmd="cc -c -g -std=c99 -pedantic -Wall -Wvariadic-macros -Werror -Os -I. -I/usr/include -I/usr/include/X11 -I/usr/include/freetype2 -I/usr/include/libpng16 -I/usr/include/freetype2 -I/usr/include/libpng16 -I/usr/include/freetype2 -I/usr/include/libpng16 -DVERSION=\"0.6\" -D_XOPEN_SOURCE=600 $dirsrc/$appname.c -o $dirbuildexe/$appname.o"
+	cmd="cc -c -g -std=c99 -pedantic -Wall -Wvariadic-macros -Werror -Os -I. -I/usr/include -I/usr/include/X11 -I/usr/include/freetype2 -I/usr/include/libpng16 -I/usr/include/freetype2 -I/usr/include/libpng16 -I/usr/include/freetype2 -I/usr/include/libpng16 -DVERSION=\"0.6\" -D_XOPEN_SOURCE=600 -pthread $dirsrc/$appname.c -o $dirbuildexe/$appname.o"
 	echo $cmd
 	$cmd
 	fn_stoponerror "$?" $LINENO
 	
 	printf "\n"
 	fn_echobold "Compiling executable"
-	cmd="cc -Werror -o $dirbuildexe/$appname $dirbuildexe/$appname.o -g -L/usr/lib -lc -L/usr/lib/X11 -lm -lrt -lX11 -lutil -lXft -lXrender -lfontconfig -lfreetype"
+	cmd="cc -Werror -o $dirbuildexe/$appname $dirbuildexe/$appname.o $dirbuildexe/lib${appname}_term.a -g -L/usr/lib -lc -L/usr/lib/X11 -lm -lrt -lX11 -lutil -lXft -lXrender -lXext -lfontconfig -lfreetype -lpng -lpthread"
 	echo $cmd
 	$cmd
 	fn_stoponerror "$?" $LINENO
@@ -49,6 +67,30 @@ if [ "$1" = "--make" ] || [ "$1" = "make" ]; then
 	fi
 
 
+elif [ "$1" = "--bench" ] || [ "$1" = "bench" ]; then
+    fn_dirEnsureClear "$dirbuildexe"
+	fn_makecore
+
+	printf "\n"
+	fn_echobold "Compiling benchmark"
+	cmd="cc -g -std=c99 -pedantic -Wall -Wvariadic-macros -Werror -Os -I. -D_XOPEN_SOURCE=600 $dirsrc/${appname}_bench.c -o $dirbuildexe/${appname}_bench $dirbuildexe/lib${appname}_term.a -lutil"
+	echo $cmd
+	$cmd
+	fn_stoponerror "$?" $LINENO
+
+	printf "\n"
+	if [ "$2" = "--save" ] || [ "$2" = "save" ]; then
+		fn_echobold "Running benchmark, saving baseline"
+		$dirbuildexe/${appname}_bench -w "$filebenchbaseline"
+	elif [ -f "$filebenchbaseline" ]; then
+		fn_echobold "Running benchmark"
+		$dirbuildexe/${appname}_bench -b "$filebenchbaseline"
+	else
+		fn_echobold "Running benchmark, no baseline: save one with ./build.sh bench save"
+		$dirbuildexe/${appname}_bench
+	fi
+	fn_stoponerror "$?" $LINENO
+
 elif [ "$1" = "--clean" ] || [ "$1" = "clean" ]; then 
     rm -rf $dirbuild
     mkdir -p $dirbuild
@@ -11,7 +11,7 @@ fn_stoponerror () {
 if [ $1 -ne 0 ]; then
         lNo=$(expr $2 - 1)
         echo "  [Error at line No $lNo. $2]"
-        exit
+        exit $1
 else
    echo "    [Success]"
 fi
@@ -75,6 +75,14 @@ Build app and run detached from terminal
 Clean build directory
 
     ./build.sh clean
+
+Benchmark the terminal core against the baseline of this machine, if any
+
+    ./build.sh bench
+
+Benchmark and save the results as the new baseline
+
+    ./build.sh bench save
 	
 Register/unregister terminal
 
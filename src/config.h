@@ -7,35 +7,38 @@
  */
 static char font[] = "hack:pixelsize=19:lcdfilter=lcddefault:hintstyle=hintnone:rgba=rgb:antialias=true:autohint=false";
 static int borderpx = 0;
-static char shell[] = "/bin/zsh";
-static char *utmp = NULL;
-static char stty_args[] = "stty raw pass8 nl -echo -iexten -cstopb 38400";
-
-/* identification sequence returned in DA and DECID */
-static char vtiden[] = "\033[?6c";
 
 /* Kerning / character bounding-box mutlipliers */
 static float cwscale = 1.0;
 static float chscale = 1.0;
 
-/*
- * word delimiter string
- *
- * More advanced example: " `'\"()[]{}"
- */
-static char worddelimiters[] = " `'\"()[]{}";
-
 /* selection timeouts (in milliseconds) */
 static unsigned int doubleclicktimeout = 300;
 static unsigned int tripleclicktimeout = 600;
 
-/* alt screens */
-static int allowaltscreen = 1;
-
 /* frames per second st should at maximum draw to the screen */
 static unsigned int xfps = 120;
 static unsigned int actionfps = 30;
 
+/*
+ * Longest time frames are held for a synchronized update (mode 2026)
+ * whose end never comes, in milliseconds.
+ */
+static unsigned int synctimeout = 150;
+
+/*
+ * Worker threads preparing the draw commands of full redraws, 0 draws
+ * every row on the main thread. Only used on TrueColor visuals.
+ */
+static unsigned int drawthreads = 4;
+
+/*
+ * Rasterize glyphs on the CPU into a MIT-SHM image and push only the
+ * damaged rows. Works on local displays with a 32 bpp TrueColor visual,
+ * otherwise drawing falls back to Xft.
+ */
+static int shmrender = 0;
+
 
 /*
  * thickness of underline and bar cursors
@@ -48,11 +51,6 @@ static unsigned int cursorthickness = 2;
  */
 static int bellvolume = 0;
 
-/* TERM value */
-static char termname[] = "xelt-256color";//available names located at xelt.terminalinfo
-
-static unsigned int tabspaces = 4;
-
 /* background opacity */
 static const int alpha = 0xcd;
 
@@ -87,10 +85,8 @@ static const char *colorname[] = {
 
 /**
  * Default colors (colorname index)
- * foreground, background, cursor
+ * cursor, the foreground and background are set in config_term.h
  */
-static unsigned int defaultfg = 257;
-static unsigned int defaultbg = 256;
 static unsigned int defaultcs = 14;
 static unsigned int defaultrcs = 257;
 
@@ -110,6 +106,30 @@ static unsigned int mouseshape = XC_xterm;
 static unsigned int mousefg = 7;
 static unsigned int mousebg = 0;
 
+/*
+ * Colours of the search matches, Alt+Shift+F, the current one on
+ * searchcurbg
+ */
+static unsigned int searchfg = 8;
+static unsigned int searchbg = 3;
+static unsigned int searchcurbg = 9;
+
+/*
+ * Links, URLs and file:line references on the screen and OSC 8
+ * hyperlinks, are underlined under the mouse and opened with linkmod and
+ * a click. openurl gets the URL, openfile the path and the line.
+ */
+static xelt_uint linkmod = ControlMask;
+static char *openurl[] = { "xdg-open", NULL };
+static char *openfile[] = { "sh", "-c", "exec xdg-open \"$1\"", "sh", NULL };
+
+/*
+ * Images, sixel and OSC 1337, take at most imagecachemax bytes on the X
+ * server, the least recently drawn are freed and uploaded again when
+ * shown.
+ */
+static size_t imagecachemax = 64 << 20;
+
 /**
  * Colors used, when the specific fg == defaultfg. So in reverse mode this
  * will reverse too. Another logic would only make the simple feature too
@@ -144,6 +164,12 @@ static xelt_Shortcut shortcuts[] = {
   { MODKEY|ShiftMask,     XK_V,           clippaste,          {.i =  0} },
   { MODKEY,               XK_Num_Lock,    numlock,            {.i =  0} },
   { XELT_SIZE_XK_NO_MOD,            XK_F11,         togglefullscreen,   {.i =  0} },
+  { MODKEY|ShiftMask,     XK_S,           togglestats,        {.i =  0} },
+  { MODKEY|ShiftMask,     XK_Return,      panenew,            {.i =  0} },
+  { MODKEY|ShiftMask,     XK_J,           panefocus,          {.i = +1} },
+  { MODKEY|ShiftMask,     XK_K,           panefocus,          {.i = -1} },
+  { MODKEY|ShiftMask,     XK_T,           panetabs,           {.i =  0} },
+  { MODKEY|ShiftMask,     XK_F,           searchtoggle,       {.i =  0} },
 };
 
 /*
@@ -0,0 +1,60 @@
+/* See LICENSE file for copyright and license details. */
+
+/*
+ * Settings of the terminal core (xelt_term.c), the front end ones are in
+ * config.h.
+ */
+
+static char shell[] = "/bin/zsh";
+static char *utmp = NULL;
+static char stty_args[] = "stty raw pass8 nl -echo -iexten -cstopb 38400";
+
+/* identification sequence returned in DA and DECID, 4 is sixel */
+static char vtiden[] = "\033[?6;4c";
+
+/*
+ * word delimiter string
+ *
+ * More advanced example: " `'\"()[]{}"
+ */
+static char worddelimiters[] = " `'\"()[]{}";
+
+/*
+ * OSC 52: programs, remote ones included, may set the clipboard with at
+ * most osc52max bytes, and read it when osc52read is set.
+ */
+static size_t osc52max = 1 << 20;
+static int osc52read = 0;
+
+/*
+ * Longest string sequence kept (title, OSC 8 link, DCS ...), a longer
+ * one is read to its end and dropped.
+ */
+static size_t strmax = 1 << 20;
+
+/*
+ * Images, sixel and OSC 1337 (PNG): the pixels or files of the images
+ * on the screens take at most imagemax bytes, the oldest are dropped.
+ */
+static size_t imagemax = 64 << 20;
+
+/*
+ * OSC 8 hyperlinks of a terminal take at most linkmax bytes: the ones
+ * no cell holds any more are freed to make room, new links are dropped
+ * if there is still none.
+ */
+static size_t linkmax = 4 << 20;
+
+/* alt screens */
+static int allowaltscreen = 1;
+
+/* TERM value */
+char termname[] = "xelt-256color";//available names located at xelt.terminalinfo
+
+static unsigned int tabspaces = 4;
+
+/*
+ * Default foreground and background (colorname index in config.h)
+ */
+unsigned int defaultfg = 257;
+unsigned int defaultbg = 256;
@@ -1,18 +1,6 @@
-#if   defined(__linux)
-	#include <pty.h>
-#elif defined(__OpenBSD__) || defined(__NetBSD__) || defined(__APPLE__)
-	#include <util.h>
-#elif defined(__FreeBSD__) || defined(__DragonFly__)
-	#include <libutil.h>
-#endif
-
-#include "xelt_defines.h"
-#include "xelt_enums.h"
+#include "xelt_term.h"
 #include "xelt_types.h"
-#include "xelt_macroses.h"
 
-char charbuf256[256];
- 
  /* function definitions used in config.h */
 static void clipcopy(const xelt_Arg *);
 static void clippaste(const xelt_Arg *);
@@ -21,92 +9,154 @@ static void selpaste(const xelt_Arg *);
 static void xzoom(const xelt_Arg *);
 static void xzoomabs(const xelt_Arg *);
 static void xzoomreset(const xelt_Arg *);
+static void searchtoggle(const xelt_Arg *);
 static void printsel(const xelt_Arg *);
 static void printscreen(const xelt_Arg *) ;
 static void toggleprinter(const xelt_Arg *);
 static void sendbreak(const xelt_Arg *);
 static void togglefullscreen(const xelt_Arg *);
+static void togglestats(const xelt_Arg *);
+static void panenew(const xelt_Arg *);
+static void panefocus(const xelt_Arg *);
+static void panetabs(const xelt_Arg *);
 //
-static void printAndExit(const char *, ...);
 static void draw(void);
 static void redraw(void);
 static void drawregion(int, int, int, int);
-static void execsh(void);
-static void stty(void);
-static void sigchld(int);
+static void xdrawrow(int, int, int, int);
+static void usage(void);
+static void xmapwait(void);
 static void run(void);
+static void xreplay(char *, int);
+static void xreplayframe(void);
+static int xsynchold(void);
 
-static void csidump(void);
-static void csihandle(void);
-static void csiparse(void);
-static void csireset(void);
-static int eschandle(xelt_uchar);
-static void strdump(void);
-static void strhandle(void);
-static void strparse(void);
-static void strreset(void);
-
-static void tprinter(char *, size_t);
-static void tdumpsel(void);
-static void tdumpline(int);
-static void tdump(void);
-static void tclearregion(int, int, int, int);
-static void tcursor(int);
-static void tdeletechar(int);
-static void tdeleteline(int);
-static void tinsertblank(int);
-static void tinsertblankline(int);
-static int tlinelen(int);
-static void tmoveto(int, int);
-static void tmoveato(int, int);
-static void tnew(int, int);
-static void tnewline(int);
-static void tputtab(int);
-static void tputc(xelt_CharCode);
-static void treset(void);
-static void tresize(int, int);
-static void tscrollup(int, int);
-static void tscrolldown(int, int);
-static void tsetcolorattr(int *, int);
-static void tsetchar(xelt_CharCode, xelt_Glyph *, int, int);
-static void tsetscroll(int, int);
-static void tswapscreen(void);
-static void tsetdirt(int, int);
-static void tsetmode(int, int, int *, int);
-static void tfulldirt(void);
-// static void techo(xelt_CharCode);
-static void tcontrolcode(xelt_uchar );
-static void tdectest(char );
-static void tdeftran(char);
 static inline int match(xelt_uint, xelt_uint);
-static void ttynew(void);
-static size_t ttyread(void);
-static void ttyresize(void);
-static void ttywrite1(const char *, size_t);
-static void tstrsequence(xelt_uchar);
 
 static inline xelt_ushort sixd_to_16bit(int);
+static xelt_Font *xglyphfont(xelt_ushort, int *);
+static xelt_GlyphIndex *xglyphindexslot(xelt_CharCode, int);
+static xelt_GlyphIndex *xglyphindexput(xelt_CharCode, int, XftFont *, FT_UInt);
+static void xglyphindexclear(void);
+static FT_UInt xlookupglyph(xelt_Font *, int, xelt_CharCode, XftFont **);
 static int xmakeglyphfontspecs(XftGlyphFontSpec *, const xelt_Glyph *, int, int, int);
+static int xmakeglyphcolors(xelt_Glyph, xelt_Color *, xelt_Color *);
 static void xdrawglyphfontspecs(const XftGlyphFontSpec *, xelt_Glyph, int, int, int);
+static void xdrawglyphrun(const XftGlyphFontSpec *, xelt_Glyph, xelt_Color *, xelt_Color *, int, int, int);
 static void xdrawglyph(xelt_Glyph, int, int);
 static void xhints(void);
 static void xclear(int, int, int, int);
+static void xdrawrect(xelt_Color *, int, int, int, int);
 static void xdrawcursor(void);
 static void xinit(void);
+static void xinitatoms(void);
+static void xinitwin(void);
 static void xloadcols(void);
 static int xsetcolorname(int, const char *);
 static int xgeommasktogravity(int);
 static int xloadfont(xelt_Font *, FcPattern *);
 static void xloadfonts(char *, double);
 static void xsettitle(char *);
+static void xbell(void);
+static void xsetcursorstyle(int);
 static void window_title_set(void);
-static void xsetpointermotion(int);
 static void xseturgency(int);
 static void xsetsel(char *, Time);
+static void xsetclipboard(const char *, char *, size_t);
+static void xgetclipboard(const char *);
+static void xosc52notify(Atom);
 static void xunloadfont(xelt_Font *);
 static void xunloadfonts(void);
 static void xresize(int, int);
 
+static void xdrawpoolinit(void);
+static void *xdrawworker(void *);
+static void xpreparerows(int);
+static void xpreparerow(xelt_RowPlan *, int);
+static int xdrawpoolprepare(int, int, int, int, int);
+static void xdrawplan(xelt_RowPlan *, int);
+
+static int xrenderbenchcmp(const void *, const void *);
+static void xrenderbenchframe(void);
+static void xrenderbench(char *);
+
+static int xstatsformat(char *, size_t);
+static void xstatsprint(FILE *);
+static void xstatssignal(int);
+static void xdrawstats(void);
+
+static int xshmerror(Display *, XErrorEvent *);
+static void xshminit(void);
+static int xshmattach(xelt_ShmSegment *);
+static Bool xshmiscompletion(Display *, XEvent *, XPointer);
+static void xshmwait(xelt_ShmSegment *);
+static void xshmfree(void);
+static void xshmresize(void);
+static inline uint32_t xshmpixel(const xelt_Color *);
+static inline uint32_t xshmblend(uint32_t, uint32_t, uint32_t);
+static void xshmfillrect(xelt_Color *, int, int, int, int);
+static void xshmdrawglyphs(xelt_Color *, const XftGlyphFontSpec *, int, int, int, int, int);
+static void xshmflush(void);
+static int xshmloadflags(XftFont *);
+static xelt_GlyphBitmap *xshmglyph(XftFont *, FT_UInt);
+static void xshmclearcache(void);
+
+static void xpaneinit(void);
+static void xpaneload(int);
+static void xpanelayout(int, int);
+static void xpanedraw(void);
+static void xpaneselect(int);
+static int xpaneat(int);
+static void xpaneclosed(void);
+static void xpaneclose(int);
+static void xpanehangup(void);
+
+static void xsearchfree(void);
+static void xsearchrequery(void);
+static void xsearchend(void);
+static void xsearchkey(KeySym, xelt_uint, char *, int);
+static void xsearchrow(int);
+static void xsearchrows(int, int);
+static void xsearchglyph(xelt_Glyph *, int, int);
+static void xsearchjump(int);
+static void xsearchbar(void);
+
+static void xlinkfree(void);
+static void xlinkindex(void);
+static void xlinkrows(int, int);
+static void xlinkadd(xelt_LinkRow *, int, int, int);
+static void xlinkrow(int);
+static int xlinkat(int, int, int *, int *);
+static void xlinkdirty(void);
+static void xlinkhover(int, int);
+static void xlinkglyph(xelt_Glyph *, int, int);
+static void xlinkspawn(char **, char **);
+static int xlinkopen(int, int);
+
+static void ximageglyph(xelt_Glyph *);
+static void ximagerow(int, int, int);
+static int ximagepng(const xelt_Image *, xelt_uchar *);
+static void ximageevict(size_t);
+static xelt_ImageEntry *ximageupload(const xelt_Image *);
+static void ximagescale(xelt_ImageEntry *);
+static xelt_ImageEntry *ximageget(uint32_t);
+static void ximageflush(void);
+
+static void xframeinit(int);
+static void xframeload(int);
+static int xframeof(Window);
+static void xframeevent(XEvent *);
+static void xframenew(char *, char **);
+static void xframeclose(void);
+static int xdaemonpath(struct sockaddr_un *);
+static int xdaemonconnect(struct sockaddr_un *);
+static void xdaemon(void);
+static void xdaemonaccept(void);
+static void xdaemondrop(int);
+static void xdaemonread(int);
+static void xdaemonpoll(fd_set *);
+static void xclient(char **);
+
 static void evhandler_expose(XEvent *);
 static void evhandler_visibility(XEvent *);
 static void evhandler_unmap(XEvent *);
@@ -123,31 +173,19 @@ static void evhandler_propnotify(XEvent *);
 static void evhandler_selnotify(XEvent *);
 static void evhandler_selclear(XEvent *);
 static void evhandler_selrequest(XEvent *);
+static size_t xincrchunk(void);
+static char *xincrbuf(void);
+static void xincrlazy(XSelectionRequestEvent *);
+static void xincrstart(XSelectionRequestEvent *, char *, long);
+static void xincrkeep(void);
+static int xincrnext(XEvent *);
 
-static void selinit(void);
-static void selnormalize(void);
-static inline int selected(int, int);
-static char *getsel(void);
 static void selcopy(Time);
-static void selscroll(int, int);
-static void selsnap(int *, int *, int);
 static int x2col(int);
 static int y2row(int);
 static void getbuttoninfo(XEvent *);
 static void mousereport(XEvent *);
 
-static size_t utf8decode(char *, xelt_CharCode *, size_t);
-static xelt_CharCode utf8decodebyte(char, size_t *);
-static size_t utf8encode(xelt_CharCode, char *);
-static char utf8encodebyte(xelt_CharCode, size_t);
-static char *utf8strchr(char *s, xelt_CharCode u);
-static size_t utf8validate(xelt_CharCode *, size_t);
-
-static ssize_t xwrite(int, const char *, size_t);
-static void *xmalloc(size_t);
-static void *xrealloc(void *, size_t);
-static char *xstrdup(char *);
-
 struct timespec drawtimeout;
 struct timespec  *tv = NULL;
 struct timespec  now;
@@ -0,0 +1,364 @@
+/* See LICENSE for license details. */
+
+/*
+ * Throughput benchmark of the terminal core (libxelt_term.a). Canned
+ * workloads are fed through twrite() without any display, the best of
+ * a few rounds is reported in MB/s and ns/byte.
+ *
+ * -b file  compare with a baseline, exit 1 on a regression
+ * -w file  write the results as the new baseline
+ * -r file  also replay a capture made with xelt -r
+ * -p file  profile the escape sequences, report in file at exit
+ */
+
+#include <locale.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xelt_term.h"
+#include "arg.h"
+
+enum {
+	XELT_BENCH_SIZE = 4 << 20,  /* bytes per workload */
+	XELT_BENCH_SLACK = 64 << 10, /* room for the last frame of a workload */
+	XELT_BENCH_ROUNDS = 5,      /* best of */
+	XELT_BENCH_TOLERANCE = 20,  /* % slower than baseline that fails */
+	XELT_BENCH_COLS = 80,
+	XELT_BENCH_ROWS = 24,
+};
+
+typedef struct {
+	char *name;
+	void (*gen)(void);
+	double mbps;
+} xelt_BenchLoad;
+
+static void usage(void);
+static void bput(const char *, ...);
+static unsigned int brand(void);
+static void genascii(void);
+static void gensgr(void);
+static void gentruecolor(void);
+static void gencjk(void);
+static void gencursor(void);
+static void genscroll(void);
+static double benchrun(void);
+static double benchreplay(char *, long *);
+static double baselineget(char *, char *);
+static int baselinewrite(char *);
+
+char *argv0;
+
+static char *buf;
+static size_t buflen;
+static unsigned int seed = 1;
+
+static char words[] =
+	"the quick brown fox jumps over the lazy dog while pack my box with "
+	"five dozen liquor jugs and sphinx of black quartz judge my vow ";
+
+static xelt_BenchLoad loads[] = {
+	{ "ascii",      genascii },
+	{ "sgr",        gensgr },
+	{ "truecolor",  gentruecolor },
+	{ "cjk",        gencjk },
+	{ "cursor",     gencursor },
+	{ "scroll",     genscroll },
+};
+
+void
+usage(void)
+{
+	printAndExit("usage: %s [-b baseline] [-w baseline] [-r capture] "
+			"[-p report]\n", argv0);
+}
+
+void
+bput(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf + buflen, XELT_BENCH_SIZE + XELT_BENCH_SLACK - buflen,
+			fmt, ap);
+	va_end(ap);
+	if (n > 0)
+		buflen += n;
+}
+
+/* deterministic, so every run feeds the same bytes */
+unsigned int
+brand(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* plain text dump, cat of a log file */
+void
+genascii(void)
+{
+	int off;
+
+	while (buflen < XELT_BENCH_SIZE) {
+		off = brand() % (sizeof(words) - 80);
+		bput("%.79s\r\n", words + off);
+	}
+}
+
+/* a colour change every few characters, ls --color or a compiler */
+void
+gensgr(void)
+{
+	int x;
+
+	while (buflen < XELT_BENCH_SIZE) {
+		for (x = 0; x < 76; x += 4) {
+			bput("\033[%d;%dm%.4s", 30 + brand() % 8,
+					40 + brand() % 8, words + brand() % 64);
+			if (brand() % 8 == 0)
+				bput("\033[9%dm", brand() % 8);
+		}
+		bput("\033[0m\r\n");
+	}
+}
+
+/* 24-bit colour per word, syntax highlighters */
+void
+gentruecolor(void)
+{
+	int x;
+
+	while (buflen < XELT_BENCH_SIZE) {
+		for (x = 0; x < 76; x += 6) {
+			bput("\033[38;2;%d;%d;%dm%.6s", brand() % 256,
+					brand() % 256, brand() % 256,
+					words + brand() % 64);
+			if (brand() % 4 == 0)
+				bput("\033[48;2;%d;%d;%dm", brand() % 256,
+						brand() % 256, brand() % 256);
+		}
+		bput("\033[0m\r\n");
+	}
+}
+
+/* double width characters mixed with some ascii */
+void
+gencjk(void)
+{
+	char c[XELT_SIZE_UTF + 1];
+	int x, n;
+
+	while (buflen < XELT_BENCH_SIZE) {
+		for (x = 0; x < 78; x += 2) {
+			if (brand() % 16 == 0) {
+				bput("%.2s", words + brand() % 64);
+				continue;
+			}
+			n = utf8encode(0x4E00 + brand() % 0x5000, c);
+			c[n] = '\0';
+			bput("%s", c);
+		}
+		bput("\r\n");
+	}
+}
+
+/* full screen editor: redraw of every row, then scattered edits */
+void
+gencursor(void)
+{
+	int y, i;
+
+	while (buflen < XELT_BENCH_SIZE) {
+		bput("\033[H");
+		for (y = 1; y < XELT_BENCH_ROWS; y++) {
+			bput("\033[%d;1H\033[33m%4d \033[37m%.60s\033[K", y, y,
+					words + brand() % 64);
+		}
+		bput("\033[%d;1H\033[34;47m%-79s\033[0m", XELT_BENCH_ROWS,
+				"-- INSERT --");
+		for (i = 0; i < 64; i++) {
+			bput("\033[%d;%dH%.8s", 1 + brand() % (XELT_BENCH_ROWS - 1),
+					6 + brand() % 60, words + brand() % 64);
+		}
+	}
+}
+
+/* output scrolling inside a region, a pager with a status line */
+void
+genscroll(void)
+{
+	bput("\033[2;%dr\033[%d;1H", XELT_BENCH_ROWS - 1, XELT_BENCH_ROWS - 1);
+	while (buflen < XELT_BENCH_SIZE)
+		bput("%.79s\n\r", words + brand() % 64);
+	bput("\033[r");
+}
+
+/*
+ * Feed the workload from a reset terminal, best time of a few rounds.
+ */
+double
+benchrun(void)
+{
+	struct timespec start, end;
+	double ns, best = 0;
+	int i;
+
+	for (i = 0; i < XELT_BENCH_ROUNDS; i++) {
+		twrite("\033c", 2);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		twrite(buf, buflen);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = (end.tv_sec - start.tv_sec) * 1E9
+			+ (end.tv_nsec - start.tv_nsec);
+		if (!best || ns < best)
+			best = ns;
+	}
+
+	return best;
+}
+
+/*
+ * Same for a capture, which is read again every round.
+ */
+double
+benchreplay(char *path, long *len)
+{
+	struct timespec start, end;
+	double ns, best = 0;
+	int i;
+
+	for (i = 0; i < XELT_BENCH_ROUNDS; i++) {
+		twrite("\033c", 2);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		*len = treplay(path, 0, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = (end.tv_sec - start.tv_sec) * 1E9
+			+ (end.tv_nsec - start.tv_nsec);
+		if (!best || ns < best)
+			best = ns;
+	}
+
+	return best;
+}
+
+/*
+ * MB/s of the workload in the baseline file, 0 if unknown.
+ */
+double
+baselineget(char *path, char *name)
+{
+	FILE *f;
+	char line[128], key[64];
+	double mbps, found = 0;
+
+	if (!(f = fopen(path, "r")))
+		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%63s %lf", key, &mbps) == 2
+				&& !strcmp(key, name))
+			found = mbps;
+	}
+	fclose(f);
+
+	return found;
+}
+
+int
+baselinewrite(char *path)
+{
+	FILE *f;
+	int i;
+
+	if (!(f = fopen(path, "w")))
+		return -1;
+	fprintf(f, "# workload MB/s, refresh with ./build.sh bench save\n");
+	for (i = 0; i < LEN(loads); i++)
+		fprintf(f, "%s %.1f\n", loads[i].name, loads[i].mbps);
+
+	return fclose(f);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *basefile = NULL, *savefile = NULL, *replayfile = NULL;
+	double ns, base;
+	long len;
+	int i, regressed = 0;
+	FILE *out;
+
+	ARGBEGIN {
+	case 'b':
+		basefile = EARGF(usage());
+		break;
+	case 'w':
+		savefile = EARGF(usage());
+		break;
+	case 'r':
+		replayfile = EARGF(usage());
+		break;
+	case 'p':
+		tprofile(EARGF(usage()));
+		break;
+	default:
+		usage();
+	} ARGEND;
+
+	/* the core reports unknown sequences on stdout and stderr */
+	if (!(out = fdopen(dup(1), "w")))
+		printAndExit("Couldn't duplicate stdout\n");
+	if (!freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr))
+		printAndExit("Couldn't open /dev/null\n");
+
+	if (!setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	buf = xmalloc(XELT_BENCH_SIZE + XELT_BENCH_SLACK);
+	tnew(XELT_BENCH_COLS, XELT_BENCH_ROWS, NULL);
+
+	fprintf(out, "%-12s %10s %10s %10s\n", "workload", "MB/s",
+			"ns/byte", "baseline");
+	for (i = 0; i < LEN(loads); i++) {
+		buflen = 0;
+		loads[i].gen();
+		ns = benchrun();
+		loads[i].mbps = buflen / ns * 1E3;
+
+		fprintf(out, "%-12s %10.1f %10.2f", loads[i].name,
+				loads[i].mbps, ns / buflen);
+		if (basefile && (base = baselineget(basefile, loads[i].name))) {
+			fprintf(out, " %10.1f", base);
+			if (loads[i].mbps < base * (100 - XELT_BENCH_TOLERANCE) / 100) {
+				fprintf(out, "  REGRESSION");
+				regressed = 1;
+			}
+		}
+		fputc('\n', out);
+	}
+
+	if (replayfile) {
+		ns = benchreplay(replayfile, &len);
+		if (len <= 0) {
+			fprintf(out, "Couldn't replay %s\n", replayfile);
+			regressed = 1;
+		} else {
+			fprintf(out, "%-12s %10.1f %10.2f\n", "replay",
+					len / ns * 1E3, ns / len);
+		}
+	}
+
+	if (savefile && baselinewrite(savefile) < 0) {
+		fprintf(out, "Couldn't write %s\n", savefile);
+		regressed = 1;
+	}
+	fclose(out);
+
+	return regressed;
+}
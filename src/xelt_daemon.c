@@ -0,0 +1,372 @@
+/*
+ * Daemon mode, xelt -d, and its client, xelt -c.
+ *
+ * The daemon keeps the display connection, the fonts, the colours and
+ * the glyph index, and opens a window for every client: xelt -c sends
+ * its directory and command on a Unix socket and exits at once. The
+ * messages are read by the event loop as they come, see xdaemonpoll(),
+ * and the shells of a window start in its directory. Each
+ * window is a frame holding its xelt_Window, its panes and its MIT-SHM
+ * image. Like the panes, one frame at a time is loaded in the globals,
+ * see xframeload(); the event loop loads the frame of every X event,
+ * readable tty and window to draw. Without -d there is a single frame.
+ */
+
+void
+xframeinit(int n)
+{
+	frames.n = n;
+	frames.cur = n ? 0 : -1;
+	frames.sock = -1;
+	if (n) {
+		frames.list = xmalloc(sizeof(*frames.list));
+		memset(frames.list, 0, sizeof(*frames.list));
+	}
+}
+
+/*
+ * Swap frame j into xelt_windowmain, panes and shmimg, -1 only saves
+ * the loaded one. The character size belongs to the shared fonts.
+ */
+void
+xframeload(int j)
+{
+	xelt_Frame *f;
+	int cw = xelt_windowmain.charwidth, ch = xelt_windowmain.charheight;
+
+	if (j == frames.cur)
+		return;
+	if (frames.cur >= 0) {
+		if (panes.loaded >= 0)
+			tsave(&panes.list[panes.loaded].state);
+		panes.loaded = -1;
+		f = &frames.list[frames.cur];
+		f->win = xelt_windowmain;
+		f->panes = panes;
+		f->shm = shmimg;
+		f->search = search;
+		f->links = links;
+	}
+	frames.cur = j;
+	if (j < 0)
+		return;
+
+	f = &frames.list[j];
+	xelt_windowmain = f->win;
+	xelt_windowmain.charwidth = cw;
+	xelt_windowmain.charheight = ch;
+	panes = f->panes;
+	shmimg = f->shm;
+	search = f->search;
+	links = f->links;
+	xpaneload(panes.cur);
+}
+
+/* Frame of the window w, -1 for none */
+int
+xframeof(Window w)
+{
+	int j;
+
+	for (j = 0; j < frames.n; j++) {
+		if (w == (j == frames.cur ? xelt_windowmain.id
+					: frames.list[j].win.id))
+			return j;
+	}
+	return -1;
+}
+
+/*
+ * Handle ev with the frame of its window loaded.
+ */
+void
+xframeevent(XEvent *ev)
+{
+	int j;
+
+	/* the requestor of a selection sent in chunks is not ours */
+	if (nincrs && xincrnext(ev))
+		return;
+	/*
+	 * This XFilterEvent call is required because of XOpenIM. It
+	 * does filter out the key event and some client message for
+	 * the input method too.
+	 */
+	if (XFilterEvent(ev, None))
+		return;
+	/* events of a window closed since are dropped */
+	if ((j = xframeof(ev->xany.window)) < 0)
+		return;
+	xframeload(j);
+	if (handler[ev->type])
+		(handler[ev->type])(ev);
+}
+
+/*
+ * Open a window running cmd, a shell when NULL, in dir and leave it
+ * loaded.
+ */
+void
+xframenew(char *dir, char **cmd)
+{
+	xframeload(-1);
+	frames.list = xrealloc(frames.list, (frames.n + 1) * sizeof(*frames.list));
+	memset(&frames.list[frames.n], 0, sizeof(*frames.list));
+	frames.cur = frames.n++;
+
+	/* the display, atoms and input method stay, the rest is new */
+	xelt_windowmain.state = 0;
+	xelt_windowmain.left = xelt_windowmain.top = 0;
+	xelt_windowmain.gmask = 0;
+	xelt_windowmain.isfixed = False;
+	xelt_windowmain.cursorstyle = cursorshape;
+	memset(&shmimg, 0, sizeof(shmimg));
+	memset(&search, 0, sizeof(search));
+	memset(&links, 0, sizeof(links));
+	links.hovery = -1;
+	xpaneinit();
+	panes.dir = xstrdup(dir);
+	tnew(80, 24, &termcallbacks);
+
+	/* the requested size until the first ConfigureNotify */
+	xinitwin();
+	cresize(0, 0);
+	panes.list[0].fd = ttynew(NULL, NULL, panes.dir, cmd);
+	ttyresize(xelt_windowmain.ttywidth, xelt_windowmain.ttyheight);
+}
+
+/*
+ * Close the loaded frame, its panes and its window. Without -d the
+ * process exits instead.
+ */
+void
+xframeclose(void)
+{
+	Display *dpy = xelt_windowmain.display;
+	int i;
+
+	for (i = 0; i < panes.n; i++) {
+		xpaneload(i);
+		tfree();
+	}
+	if (frames.sock < 0)
+		exit(0);
+	free(panes.list);
+	free(panes.dir);
+	memset(&panes, 0, sizeof(panes));
+	panes.loaded = -1;
+
+	xshmfree();
+	free(shmimg.cache);
+	xsearchfree();
+	xlinkfree();
+	XDestroyIC(xelt_windowmain.inputcontext);
+	XftDrawDestroy(xelt_windowmain.draw);
+	XFreePixmap(dpy, xelt_windowmain.drawbuf);
+	XDestroyWindow(dpy, xelt_windowmain.id);
+
+	memmove(&frames.list[frames.cur], &frames.list[frames.cur + 1],
+			(frames.n - frames.cur - 1) * sizeof(*frames.list));
+	frames.n--;
+	frames.cur = -1;
+}
+
+/*
+ * Address of the daemon of this user and display, 0 when it doesn't
+ * fit in a sockaddr_un.
+ */
+int
+xdaemonpath(struct sockaddr_un *addr)
+{
+	char *dir = getenv("XDG_RUNTIME_DIR"), *dpy = getenv("DISPLAY"), *p;
+	size_t len;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/xelt-%u-",
+			dir ? dir : "/tmp", (unsigned)getuid());
+	if (len >= sizeof(addr->sun_path))
+		return 0;
+	p = addr->sun_path + len;
+	len += snprintf(p, sizeof(addr->sun_path) - len, "%s", dpy ? dpy : "");
+	if (len >= sizeof(addr->sun_path))
+		return 0;
+	for (; *p; p++) {
+		if (*p == '/')
+			*p = '_';
+	}
+	return 1;
+}
+
+/* Socket connected to the daemon, -1 when none listens */
+int
+xdaemonconnect(struct sockaddr_un *addr)
+{
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		printAndExit("socket failed: %s\n", strerror(errno));
+	if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * xelt -d: serve the windows asked for by xelt -c until killed.
+ */
+void
+xdaemon(void)
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd;
+
+	if (!xdaemonpath(&addr))
+		printAndExit("Socket path too long\n");
+	if ((fd = xdaemonconnect(&addr)) >= 0)
+		printAndExit("A daemon already listens on %s\n", addr.sun_path);
+	/* left by a daemon that is gone */
+	unlink(addr.sun_path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		printAndExit("socket failed: %s\n", strerror(errno));
+	/* only the user may open windows */
+	mask = umask(077);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		printAndExit("Couldn't bind %s: %s\n", addr.sun_path, strerror(errno));
+	umask(mask);
+	if (listen(fd, 8) < 0)
+		printAndExit("listen failed: %s\n", strerror(errno));
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	frames.sock = fd;
+	run();
+}
+
+/*
+ * A client connects: its message is read as it comes, without blocking
+ * the windows.
+ */
+void
+xdaemonaccept(void)
+{
+	xelt_Client *c;
+	int fd;
+
+	if ((fd = accept(frames.sock, NULL, NULL)) < 0)
+		return;
+	if (frames.nclients == XELT_SIZE_DAEMON_CLIENTS) {
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	frames.clients = xrealloc(frames.clients,
+			(frames.nclients + 1) * sizeof(*frames.clients));
+	c = &frames.clients[frames.nclients++];
+	c->fd = fd;
+	c->len = 0;
+	clock_gettime(CLOCK_MONOTONIC, &c->start);
+}
+
+void
+xdaemondrop(int i)
+{
+	close(frames.clients[i].fd);
+	frames.clients[i] = frames.clients[--frames.nclients];
+}
+
+/*
+ * Read what client i sent. It sends its directory and the words of the
+ * command, each NUL terminated, and closes: then its window is opened.
+ */
+void
+xdaemonread(int i)
+{
+	static char *args[XELT_SIZE_DAEMON_MSG + 1];
+	xelt_Client *c = &frames.clients[i];
+	ssize_t r;
+	char *p;
+	int n = 0;
+
+	/* up to the end of the message, or what there is for now */
+	for (;;) {
+		if (c->len == sizeof(c->buf)) {
+			xdaemondrop(i);
+			return;
+		}
+		if ((r = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len)) <= 0)
+			break;
+		c->len += r;
+	}
+	if (r < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (r < 0 || c->len == 0 || c->buf[c->len - 1] != '\0') {
+		xdaemondrop(i);
+		return;
+	}
+
+	for (p = c->buf; p < c->buf + c->len; p += strlen(p) + 1)
+		args[n++] = p;
+	args[n] = NULL;
+	xframenew(args[0], n > 1 ? &args[1] : NULL);
+	/* the window is open, the arguments can go */
+	xdaemondrop(i);
+}
+
+/*
+ * Accept the clients connecting, read the ones readable in rfd and drop
+ * the ones slower than XELT_DAEMON_TIMEOUT.
+ */
+void
+xdaemonpoll(fd_set *rfd)
+{
+	struct timespec now;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = frames.nclients - 1; i >= 0; i--) {
+		if (FD_ISSET(frames.clients[i].fd, rfd))
+			xdaemonread(i);
+		else if (TIMEDIFF(now, frames.clients[i].start) > XELT_DAEMON_TIMEOUT)
+			xdaemondrop(i);
+	}
+	if (FD_ISSET(frames.sock, rfd))
+		xdaemonaccept();
+}
+
+/*
+ * xelt -c: ask the daemon for a window running cmd in the current
+ * directory and exit.
+ */
+void
+xclient(char **cmd)
+{
+	struct sockaddr_un addr;
+	char cwd[PATH_MAX];
+	size_t len;
+	char **c;
+	int fd;
+
+	if (!getcwd(cwd, sizeof(cwd)))
+		strcpy(cwd, "/");
+	len = strlen(cwd) + 1;
+	for (c = cmd; c && *c; c++)
+		len += strlen(*c) + 1;
+	if (len >= XELT_SIZE_DAEMON_MSG)
+		printAndExit("Command too long\n");
+
+	if (!xdaemonpath(&addr))
+		printAndExit("Socket path too long\n");
+	if ((fd = xdaemonconnect(&addr)) < 0)
+		printAndExit("No daemon on %s, start one with xelt -d\n",
+				addr.sun_path);
+	xwrite(fd, cwd, strlen(cwd) + 1);
+	for (c = cmd; c && *c; c++)
+		xwrite(fd, *c, strlen(*c) + 1);
+	close(fd);
+	exit(0);
+}
@@ -0,0 +1,217 @@
+/*
+ * Worker pool for big redraws.
+ *
+ * When many rows are dirty at once (redraw(), tfulldirt(), the screen
+ * swap) the CPU side of every dirty row is prepared in parallel: glyph
+ * lookup, run splitting and colour resolution into a xelt_RowPlan.
+ * drawregion() then submits the plans from the main thread, which is
+ * the only one talking to the X server.
+ *
+ * Workers only read the glyph index. A row holding a glyph the index
+ * doesn't know yet is marked serial and left to xdrawrow(), which
+ * resolves the glyph and adds it to the index for the next redraw.
+ */
+
+void
+xdrawpoolinit(void)
+{
+	sigset_t set, old;
+	int i;
+
+	/* colours are only resolved without the server on TrueColor */
+	if (!drawthreads || xelt_windowmain.vis->class != TrueColor)
+		return;
+
+	pthread_mutex_init(&drawpool.lock, NULL);
+	pthread_cond_init(&drawpool.start, NULL);
+	pthread_cond_init(&drawpool.done, NULL);
+	drawpool.threads = xmalloc(drawthreads * sizeof(*drawpool.threads));
+
+	/* signals are left to the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	for (i = 0; i < drawthreads; i++) {
+		if (pthread_create(&drawpool.threads[i], NULL, xdrawworker,
+				(void *)(intptr_t)(i + 1))) {
+			fprintf(stderr, "Couldn't start draw worker: %s\n",
+				strerror(errno));
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	drawpool.nthreads = i;
+}
+
+void *
+xdrawworker(void *arg)
+{
+	int part = (intptr_t)arg, generation = 0;
+
+	pthread_mutex_lock(&drawpool.lock);
+	for (;;) {
+		while (drawpool.generation == generation)
+			pthread_cond_wait(&drawpool.start, &drawpool.lock);
+		generation = drawpool.generation;
+		pthread_mutex_unlock(&drawpool.lock);
+
+		xpreparerows(part);
+
+		pthread_mutex_lock(&drawpool.lock);
+		if (--drawpool.pending == 0)
+			pthread_cond_signal(&drawpool.done);
+	}
+
+	return NULL;
+}
+
+/*
+ * Prepare every rows of the batch belonging to part, the main thread
+ * being part 0. Rows are interleaved so all parts get similar work.
+ */
+void
+xpreparerows(int part)
+{
+	int i;
+
+	for (i = part; i < drawpool.nrows; i += drawpool.nthreads + 1)
+		xpreparerow(&drawpool.plans[drawpool.rows[i]], drawpool.rows[i]);
+}
+
+/*
+ * Same work as xmakeglyphfontspecs() and xdrawrow() without sending
+ * anything, see there.
+ */
+void
+xpreparerow(xelt_RowPlan *plan, int y)
+{
+	float winy = xelt_windowmain.paney + y * xelt_windowmain.charheight, xp, yp = 0;
+	float runewidth = xelt_windowmain.charwidth;
+	xelt_ushort prevmode = USHRT_MAX;
+	xelt_Font *font = &dc.font;
+	int frcflags = XELT_FONTCACHE_NORMAL;
+	xelt_GlyphIndex *gi;
+	xelt_DrawRun *run = NULL;
+	xelt_Glyph new;
+	int x, numspecs = 0, sx1 = 1, sx2 = 0;
+
+	if (drawpool.ena_sel)
+		selrow(y, &sx1, &sx2);
+	plan->nruns = 0;
+	plan->serial = 0;
+	plan->colorallocs = 0;
+
+	xp = borderpx + drawpool.x1 * xelt_windowmain.charwidth;
+	for (x = drawpool.x1; x < drawpool.x2; x++) {
+		new = terminal.line[y][x];
+		if (new.mode == XELT_ATTR_WDUMMY)
+			continue;
+		ximageglyph(&new);
+
+		if (prevmode != new.mode) {
+			prevmode = new.mode;
+			font = xglyphfont(new.mode, &frcflags);
+			runewidth = xelt_windowmain.charwidth * ((new.mode & XELT_ATTR_WIDE) ? 2.0f : 1.0f);
+			yp = winy + font->ascent;
+		}
+
+		gi = xglyphindexslot(new.u, frcflags);
+		if (!gi->font) {
+			plan->serial = 1;
+			return;
+		}
+		plan->specs[numspecs].font = gi->font;
+		plan->specs[numspecs].glyph = gi->glyph;
+		plan->specs[numspecs].x = (short)xp;
+		plan->specs[numspecs].y = (short)yp;
+		xp += runewidth;
+
+		xsearchglyph(&new, x, y);
+		xlinkglyph(&new, x, y);
+		if (BETWEEN(x, sx1, sx2))
+			new.mode ^= XELT_ATTR_REVERSE;
+		if (!run || ATTRCMP(run->base, new)) {
+			run = &plan->runs[plan->nruns++];
+			run->base = new;
+			run->x = x;
+			run->spec = numspecs;
+			run->len = 0;
+		}
+		run->len++;
+		numspecs++;
+	}
+
+	for (run = plan->runs; run < plan->runs + plan->nruns; run++)
+		plan->colorallocs += xmakeglyphcolors(run->base, &run->fg, &run->bg);
+}
+
+/*
+ * Prepare the dirty rows of the region in parallel. Returns 0 when
+ * there are too few of them to be worth it, the rows are then drawn
+ * serially.
+ */
+int
+xdrawpoolprepare(int x1, int y1, int x2, int y2, int ena_sel)
+{
+	int y;
+
+	if (!drawpool.nthreads)
+		return 0;
+
+	if (drawpool.planrows != terminal.row || drawpool.plancols != terminal.col) {
+		for (y = 0; y < drawpool.planrows; y++) {
+			free(drawpool.plans[y].specs);
+			free(drawpool.plans[y].runs);
+		}
+		drawpool.plans = xrealloc(drawpool.plans,
+				terminal.row * sizeof(*drawpool.plans));
+		drawpool.rows = xrealloc(drawpool.rows,
+				terminal.row * sizeof(*drawpool.rows));
+		for (y = 0; y < terminal.row; y++) {
+			drawpool.plans[y].specs = xmalloc(terminal.col
+					* sizeof(*drawpool.plans[y].specs));
+			drawpool.plans[y].runs = xmalloc(terminal.col
+					* sizeof(*drawpool.plans[y].runs));
+		}
+		drawpool.planrows = terminal.row;
+		drawpool.plancols = terminal.col;
+	}
+
+	drawpool.nrows = 0;
+	for (y = y1; y < y2; y++) {
+		if (terminal.dirty[y])
+			drawpool.rows[drawpool.nrows++] = y;
+	}
+	if (drawpool.nrows < XELT_SIZE_DRAWPOOL_MINROWS)
+		return 0;
+
+	drawpool.x1 = x1;
+	drawpool.x2 = x2;
+	drawpool.ena_sel = ena_sel;
+
+	pthread_mutex_lock(&drawpool.lock);
+	drawpool.generation++;
+	drawpool.pending = drawpool.nthreads;
+	pthread_cond_broadcast(&drawpool.start);
+	pthread_mutex_unlock(&drawpool.lock);
+
+	xpreparerows(0);
+
+	pthread_mutex_lock(&drawpool.lock);
+	while (drawpool.pending > 0)
+		pthread_cond_wait(&drawpool.done, &drawpool.lock);
+	pthread_mutex_unlock(&drawpool.lock);
+
+	return 1;
+}
+
+void
+xdrawplan(xelt_RowPlan *plan, int y)
+{
+	xelt_DrawRun *run;
+
+	rstats.colorallocs += plan->colorallocs;
+	for (run = plan->runs; run < plan->runs + plan->nruns; run++) {
+		xdrawglyphrun(plan->specs + run->spec, run->base,
+				&run->fg, &run->bg, run->len, run->x, y);
+	}
+}
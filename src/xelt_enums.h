@@ -2,18 +2,24 @@ enum
 {
 	
     // glyph_attribute 
-	XELT_ATTR_BOLD       = 1,
-	XELT_ATTR_FAINT      = 1,
-	XELT_ATTR_INVISIBLE  = 1,
-	XELT_ATTR_ITALIC     = 1 ,
+	XELT_ATTR_BOLD       = 1 << 0,
+	XELT_ATTR_FAINT      = 1 << 1,
+	XELT_ATTR_INVISIBLE  = 1 << 6,
+	XELT_ATTR_ITALIC     = 1 << 2,
 	XELT_ATTR_NULL       = 0,
-	XELT_ATTR_REVERSE    = 1,
-	XELT_ATTR_STRUCK     = 1,
-	XELT_ATTR_UNDERLINE  = 1,
-	XELT_ATTR_WDUMMY     = 1,
-	XELT_ATTR_WIDE       = 1,
-	XELT_ATTR_WRAP       = 1,
+	XELT_ATTR_REVERSE    = 1 << 5,
+	XELT_ATTR_STRUCK     = 1 << 7,
+	XELT_ATTR_UNDERLINE  = 1 << 3,
+	XELT_ATTR_BLINK      = 1 << 4,
+	XELT_ATTR_WDUMMY     = 1 << 10,
+	XELT_ATTR_WIDE       = 1 << 9,
+	XELT_ATTR_LAZY       = 1 << 11, /* row marker, see tlinetouch() */
+	XELT_ATTR_PROTECTED  = 1 << 12, /* DECSCA */
+	XELT_ATTR_IMAGE      = 1 << 13, /* u is an image, fg its tile, see timage() */
+	XELT_ATTR_WRAP       = 1 << 8,
 	XELT_ATTR_BOLD_FAINT = XELT_ATTR_BOLD | XELT_ATTR_FAINT,
+	/* what SGR can change */
+	XELT_ATTR_SGR        = (1 << 8) - 1,
 
     //   CURSOR_movement 
 	XELT_CURSOR_SAVE,
@@ -37,6 +43,7 @@ enum
 	XELT_TERMINAL_HIDE        = 1 << 9,
 	XELT_TERMINAL_INSERT      = 1 << 1,
 	XELT_TERMINAL_KBDLOCK     = 1 << 8,
+	XELT_TERMINAL_LRMM        = 1 << 22,
 	XELT_TERMINAL_MOUSEBTN    = 1 << 5,
 	XELT_TERMINAL_MOUSEMANY   = 1 << 18,
 	XELT_TERMINAL_MOUSEMOTION = 1 << 6,
@@ -44,6 +51,7 @@ enum
 	XELT_TERMINAL_MOUSEX10    = 1 << 17,
 	XELT_TERMINAL_PRINT       = 1 << 20,
 	XELT_TERMINAL_REVERSE     = 1 << 7,
+	XELT_TERMINAL_SYNC        = 1 << 21,
 	XELT_TERMINAL_WRAP        = 1 << 0,
 	XELT_TERMINAL_MOUSE       = XELT_TERMINAL_MOUSEBTN|XELT_TERMINAL_MOUSEMOTION|XELT_TERMINAL_MOUSEX10|XELT_TERMINAL_MOUSEMANY,
 
@@ -80,6 +88,10 @@ enum
     //  selection_snap 
 	XELT_SELSNAP_LINE = 2,
 	XELT_SELSNAP_WORD = 1,
+
+    //  link_kind, see xelt_links.c
+	XELT_LINK_URL = 1,
+	XELT_LINK_FILE = 2,
 	
 	// XEMBED messages
 	XELT_XEMBED_FOCUS_IN  = 4,
@@ -90,12 +102,33 @@ enum
 	XELT_SIZE_UTF =  4,
 	XELT_SIZE_ESC_BUF = (128*XELT_SIZE_UTF),
 	XELT_ESC_ARG_SIZ = 16,
-	XELT_SIZE_STR_BUF = XELT_SIZE_ESC_BUF,
+	XELT_SIZE_STR_BUF = XELT_SIZE_ESC_BUF, /* first size of strescseq.buf */
+	XELT_SIZE_STR_KEEP = 16*XELT_SIZE_STR_BUF, /* ... kept between sequences */
 	XELT_SIZE_STR_ARG = XELT_ESC_ARG_SIZ,
 	XELT_SIZE_XK_ANY_MOD =  UINT_MAX,
 	XELT_SIZE_XK_NO_MOD =  0,
 	XELT_SIZE_XK_SWITCH_MOD = 1<<13,
 	XELT_SIZE_OPAQUE = 0Xff,	
+	XELT_SIZE_SHM_GLYPHCACHE = 4096, /* power of two */
+	XELT_SIZE_GLYPHINDEX = 8192, /* power of two */
+	XELT_SIZE_DRAWPOOL_MINROWS = 16, /* dirty rows worth waking the pool */
+	XELT_SIZE_PROF = 512, /* power of two, sequence kinds profiled */
+	XELT_SIZE_DAEMON_MSG = 8192, /* directory and command of xelt -c */
+	XELT_SIZE_DAEMON_CLIENTS = 16, /* xelt -c being read, more are refused */
+	XELT_DAEMON_TIMEOUT = 1000, /* ms for xelt -c to send its message */
+	XELT_SIZE_SEARCH = 256, /* bytes of the search query */
+	XELT_SIZE_LINKS = 0xffff, /* OSC 8 hyperlinks, ids fit a ushort */
+	XELT_SIZE_REAPED = 16, /* exit statuses kept, see ttystatus() */
+	XELT_OSC52_DECODE = 1, /* strescseq.osc52, the payload is decoded */
+	XELT_OSC52_GET = 2,    /* ... it is "?" */
+	XELT_OSC52_OVER = 3,   /* ... it is over osc52max */
+	XELT_SIZE_IMAGES = 4096, /* images kept by the core */
+	XELT_SIZE_SIXEL_COLORS = 256, /* sixel colour registers */
+	XELT_IMAGE_SIXEL = 1,  /* strescseq.image, a sixel DCS is decoded */
+	XELT_IMAGE_INLINE = 2, /* ... the file of OSC 1337 */
+	XELT_IMAGE_OVER = 3,   /* ... it is over imagemax */
+	XELT_IMAGE_ARGB = 1,   /* xelt_Image.kind, pixels */
+	XELT_IMAGE_PNG = 2,    /* ... a PNG file */
 	
 	// Font Ring Cache */
 	XELT_FONTCACHE_NORMAL,
@@ -103,11 +136,6 @@ enum
 	XELT_FONTCACHE_BOLD,
 	XELT_FONTCACHE_ITALICBOLD,	
 	
-	/* Mouse buttons */
-	XELT_MOUSSE_LEFT = Button1,
-	XELT_MOUSSE_MIDDLE = Button2,
-	XELT_MOUSSE_RIGHT = Button3,
-	
 	/* Control Codes */
 	XELT_CTRLCODE_APPLICATIONPROGRAMCOMMAND  = 0x9f, // APC
 	XELT_CTRLCODE_BACKSPACE = '\b',
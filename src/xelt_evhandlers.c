@@ -14,11 +14,19 @@ void evhandler_btnpress(XEvent *e)
 	struct timespec now;
 	xelt_MouseShortcut *ms;
 
+	/* a click in another pane gives it the focus */
+	xpaneselect(xpaneat(e->xbutton.y));
+
 	if (IS_SET(XELT_TERMINAL_MOUSE) && !(e->xbutton.state & forceselmod)) {
 		mousereport(e);
 		return;
 	}
 
+	if (e->xbutton.button == XELT_MOUSSE_LEFT
+			&& (e->xbutton.state & linkmod) == linkmod
+			&& xlinkopen(e->xbutton.x, e->xbutton.y))
+		return;
+
 	for (ms = mshortcuts; ms < mshortcuts + LEN(mshortcuts); ms++) {
 		if (e->xbutton.button == ms->b
 				&& match(ms->mask, e->xbutton.state)) {
@@ -94,9 +102,8 @@ void evhandler_clientmsg(XEvent *e)
 			xelt_windowmain.state &= ~XELT_WIN_FOCUSED;
 		}
 	} else if (e->xclient.data.l[0] == xelt_windowmain.wmdeletewin) {
-		/* Send SIGHUP to shell */
-		kill(pid, SIGHUP);
-		exit(0);
+		xpanehangup();
+		xframeclose();
 	}
 }
 
@@ -106,7 +113,6 @@ void evhandler_configure(XEvent *e)
 		return;
 
 	cresize(e->xconfigure.width, e->xconfigure.height);
-	ttyresize();
 }
 
 
@@ -159,13 +165,19 @@ void evhandler_keypress(XEvent *ev)
 		}
 	}
 
-	/* 2. custom keys from config.h */
+	/* 2. the query while searching */
+	if (search.active) {
+		xsearchkey(ksym, e->state, buf, len);
+		return;
+	}
+
+	/* 3. custom keys from config.h */
 	if ((customkey = kmap(ksym, e->state))) {
 		ttywrite1(customkey, strlen(customkey));
 		return;
 	}
 
-	/* 3. composed string from input method */
+	/* 4. composed string from input method */
 	if (len == 0)
 		return;
 	if (len == 1 && e->state & Mod1Mask) {
@@ -189,6 +201,9 @@ void evhandler_motion(XEvent *e)
 {
 	int oldey, oldex, oldsby, oldsey;
 
+	/* every motion comes for the links, mousereport() sorts them */
+	xlinkhover(e->xmotion.x, e->xmotion.y);
+
 	if (IS_SET(XELT_TERMINAL_MOUSE) && !(e->xbutton.state & forceselmod)) {
 		mousereport(e);
 		return;
@@ -224,11 +239,7 @@ void evhandler_visibility(XEvent *ev)
 void
 evhandler_selclear(XEvent *e)
 {
-	if (sel.ob.x == -1)
-		return;
-	sel.mode = XELT_SEL_IDLE;
-	sel.ob.x = -1;
-	tsetdirt(sel.nb.y, sel.ne.y);
+	selclear();
 }
 
 void evhandler_selnotify(XEvent *e)
@@ -238,7 +249,7 @@ void evhandler_selnotify(XEvent *e)
 	xelt_uchar *data, *last, *repl;
 	Atom type, incratom, property;
 
-	incratom = XInternAtom(xelt_windowmain.display, "INCR", 0);
+	incratom = xelt_windowmain.incr;
 
 	ofs = 0;
 	if (e->type == SelectionNotify) {
@@ -250,6 +261,10 @@ void evhandler_selnotify(XEvent *e)
 	}
 	if (property == None)
 		return;
+	if (property == xelt_windowmain.osc52) {
+		xosc52notify(property);
+		return;
+	}
 
 	do {
 		if (XGetWindowProperty(xelt_windowmain.display, xelt_windowmain.id, property, ofs,
@@ -319,11 +334,44 @@ void evhandler_selnotify(XEvent *e)
 	XDeleteProperty(xelt_windowmain.display, xelt_windowmain.id, (int)property);
 }
 
+/*
+ * The selection OSC 52 asked for has come in property, answer the panes
+ * waiting for it. A selection sent in chunks (INCR) is answered empty.
+ */
+void
+xosc52notify(Atom property)
+{
+	xelt_ulong nitems = 0, rem;
+	xelt_uchar *data = NULL;
+	Atom type;
+	int format, i;
+
+	if (XGetWindowProperty(xelt_windowmain.display, xelt_windowmain.id,
+				property, 0, LONG_MAX / 4, True, AnyPropertyType,
+				&type, &format, &nitems, &rem, &data) != Success) {
+		data = NULL;
+	}
+	if (!data || type == xelt_windowmain.incr)
+		nitems = format = 0;
+
+	for (i = 0; i < panes.n; i++) {
+		if (!panes.list[i].osc52)
+			continue;
+		xpaneload(i);
+		ttyosc52(panes.list[i].osc52 == 'p' ? "p" : "c",
+				data ? (char *)data : "", nitems * format / 8);
+		panes.list[i].osc52 = 0;
+	}
+	xpaneload(panes.cur);
+	if (data)
+		XFree(data);
+}
+
 void
 evhandler_propnotify(XEvent *e)
 {
 	XPropertyEvent *xpev;
-	Atom clipboard = XInternAtom(xelt_windowmain.display, "CLIPBOARD", 0);
+	Atom clipboard = xelt_windowmain.clipboard;
 
 	xpev = &e->xproperty;
 	if (xpev->state == PropertyNewValue &&
@@ -353,20 +401,20 @@ void evhandler_selrequest(XEvent *e)
 	/* reject */
 	xev.property = None;
 
-	xa_targets = XInternAtom(xelt_windowmain.display, "TARGETS", 0);
+	xa_targets = xelt_windowmain.targets;
 	if (xsre->target == xa_targets) {
 		/* respond with the supported type */
-		string = sel.xtarget;
+		string = xelt_windowmain.xtarget;
 		XChangeProperty(xsre->display, xsre->requestor, xsre->property,
 				XA_ATOM, 32, PropModeReplace,
 				(xelt_uchar *) &string, 1);
 		xev.property = xsre->property;
-	} else if (xsre->target == sel.xtarget || xsre->target == XA_STRING) {
+	} else if (xsre->target == xelt_windowmain.xtarget || xsre->target == XA_STRING) {
 		/*
 		 * xith XA_STRING non ascii characters may be incorrect in the
 		 * requestor. It is not our problem, use utf8.
 		 */
-		clipboard = XInternAtom(xelt_windowmain.display, "CLIPBOARD", 0);
+		clipboard = xelt_windowmain.clipboard;
 		if (xsre->selection == XA_PRIMARY) {
 			seltext = sel.primary;
 		} else if (xsre->selection == clipboard) {
@@ -377,11 +425,20 @@ void evhandler_selrequest(XEvent *e)
 				xsre->selection);
 			return;
 		}
-		if (seltext != NULL) {
-			XChangeProperty(xsre->display, xsre->requestor,
-					xsre->property, xsre->target,
-					8, PropModeReplace,
-					(xelt_uchar *)seltext, strlen(seltext));
+		if (xsre->selection == XA_PRIMARY && sel.lazy) {
+			xincrlazy(xsre);
+			xev.property = xsre->property;
+		} else if (seltext != NULL) {
+			/* our own windows already listen to their properties */
+			if (strlen(seltext) > xincrchunk()
+					&& xframeof(xsre->requestor) < 0) {
+				xincrstart(xsre, seltext, strlen(seltext));
+			} else {
+				XChangeProperty(xsre->display, xsre->requestor,
+						xsre->property, xsre->target,
+						8, PropModeReplace,
+						(xelt_uchar *)seltext, strlen(seltext));
+			}
 			xev.property = xsre->property;
 		}
 	}
@@ -390,3 +447,154 @@ void evhandler_selrequest(XEvent *e)
 	if (!XSendEvent(xsre->display, xsre->requestor, 1, 0, (XEvent *) &xev))
 		fprintf(stderr, "Error sending SelectionNotify event\n");
 }
+
+/*
+ * Bytes of selection sent in one request, bigger selections go through
+ * INCR so that a request stays short and the server accepts it.
+ */
+size_t
+xincrchunk(void)
+{
+	return XMaxRequestSize(xelt_windowmain.display) * 4 - 256;
+}
+
+/* Chunk being sent from a lazy selection */
+char *
+xincrbuf(void)
+{
+	static char *buf;
+
+	if (!buf)
+		buf = xmalloc(xincrchunk());
+	return buf;
+}
+
+/*
+ * Serve the lazy primary selection straight from the screen, at once
+ * when it fits in a chunk.
+ */
+void
+xincrlazy(XSelectionRequestEvent *xsre)
+{
+	xelt_SelReader r = { 0, -1, 0 };
+	char *buf = xincrbuf();
+	size_t n;
+
+	n = getselread(&r, buf, xincrchunk());
+	if (!r.done && xframeof(xsre->requestor) < 0) {
+		xincrstart(xsre, NULL, n);
+		return;
+	}
+	if (!r.done) {
+		selencode();
+		buf = sel.primary;
+		n = strlen(buf);
+	}
+	XChangeProperty(xsre->display, xsre->requestor, xsre->property,
+			xsre->target, 8, PropModeReplace, (xelt_uchar *)buf, n);
+}
+
+/*
+ * Announce a selection too big for one request, len bytes at least.
+ * The requestor deletes the property to ask for each chunk, see
+ * xincrnext(). Without text the lazy selection is read as it goes.
+ */
+void
+xincrstart(XSelectionRequestEvent *xsre, char *text, long len)
+{
+	Atom incratom = xelt_windowmain.incr;
+	xelt_Incr *t;
+
+	incrs = xrealloc(incrs, (nincrs + 1) * sizeof(*incrs));
+	t = &incrs[nincrs++];
+	t->requestor = xsre->requestor;
+	t->property = xsre->property;
+	t->target = xsre->target;
+	t->data = text ? xstrdup(text) : NULL;
+	t->len = len;
+	t->ofs = 0;
+	t->reader = (xelt_SelReader){ 0, -1, 0 };
+
+	XSelectInput(xsre->display, xsre->requestor,
+			PropertyChangeMask | StructureNotifyMask);
+	XChangeProperty(xsre->display, xsre->requestor, xsre->property,
+			incratom, 32, PropModeReplace, (xelt_uchar *)&len, 1);
+}
+
+/*
+ * The lazy selection is replaced, the transfers still reading it get
+ * its text.
+ */
+void
+xincrkeep(void)
+{
+	xelt_Incr *t;
+
+	for (t = incrs; t < incrs + nincrs; t++) {
+		if (t->data)
+			continue;
+		selencode();
+		t->data = xstrdup(sel.primary ? sel.primary : "");
+		t->len = strlen(t->data);
+	}
+}
+
+/*
+ * Send the next chunk of a transfer whose requestor deleted the last
+ * one, the empty chunk after the data ends it. 1 when e was the event
+ * of a requestor.
+ */
+int
+xincrnext(XEvent *e)
+{
+	Window w = e->xany.window;
+	xelt_Incr *t;
+	size_t n;
+	char *p;
+	int i, found = 0;
+
+	for (i = 0; i < nincrs; i++) {
+		t = &incrs[i];
+		if (t->requestor != w)
+			continue;
+		found = 1;
+		if (e->type == PropertyNotify) {
+			if (e->xproperty.state != PropertyDelete
+					|| e->xproperty.atom != t->property)
+				continue;
+			/* the lazy selection was encoded meanwhile */
+			if (!t->data && !sel.lazy) {
+				t->data = xstrdup(sel.primary ? sel.primary : "");
+				t->len = strlen(t->data);
+			}
+			if (t->data) {
+				p = t->data + t->ofs;
+				n = MIN(t->len - t->ofs, xincrchunk());
+			} else {
+				p = xincrbuf();
+				n = getselread(&t->reader, p, xincrchunk());
+			}
+			XChangeProperty(e->xany.display, w, t->property,
+					t->target, 8, PropModeReplace,
+					(xelt_uchar *)p, n);
+			t->ofs += n;
+			if (n > 0)
+				return 1;
+		} else if (e->type != DestroyNotify) {
+			continue;
+		}
+
+		/* done, or the requestor is gone */
+		free(t->data);
+		memmove(t, t + 1, (--nincrs - i) * sizeof(*incrs));
+		i--;
+	}
+	if (!found)
+		return 0;
+
+	for (i = 0; i < nincrs && incrs[i].requestor != w; i++)
+		;
+	if (i == nincrs && e->type != DestroyNotify)
+		XSelectInput(e->xany.display, w, NoEventMask);
+	return 1;
+}
@@ -0,0 +1,260 @@
+/*
+ * Images of the core, sixel and OSC 1337, drawn over their cells, see
+ * timage().
+ *
+ * An image is decoded once, PNG with libpng, and uploaded into an ARGB
+ * Pixmap whose Picture is scaled to the cells by a transform.
+ * drawregion() queues the image cells of the rows it draws and draw()
+ * composites them once the rows are on the back buffer, after the
+ * MIT-SHM flush: a redraw or a scroll composites again, without
+ * decoding. The least recently drawn images are freed on the server past
+ * imagecachemax bytes.
+ */
+
+/* Image cells are drawn as blanks under the image */
+void
+ximageglyph(xelt_Glyph *g)
+{
+	if (!(g->mode & XELT_ATTR_IMAGE))
+		return;
+	g->u = ' ';
+	g->fg = defaultfg;
+	g->mode &= ~XELT_ATTR_IMAGE;
+}
+
+/*
+ * Queue the image cells x1 to x2 of row y of the loaded pane. The cells
+ * of consecutive tiles of an image are one composite.
+ */
+void
+ximagerow(int y, int x1, int x2)
+{
+	xelt_Line line = terminal.line[y];
+	xelt_ImageDraw *d;
+	int x, n, cw = xelt_windowmain.charwidth, ch = xelt_windowmain.charheight;
+
+	for (x = x1; x < x2; x += n) {
+		n = 1;
+		if (!(line[x].mode & XELT_ATTR_IMAGE))
+			continue;
+		while (x + n < x2 && (line[x+n].mode & XELT_ATTR_IMAGE)
+				&& line[x+n].u == line[x].u
+				&& line[x+n].fg == line[x].fg + n)
+			n++;
+
+		if (images.nqueue == images.queuesize) {
+			images.queuesize = images.queuesize ?
+				2 * images.queuesize : 64;
+			images.queue = xrealloc(images.queue,
+					images.queuesize * sizeof(*images.queue));
+		}
+		d = &images.queue[images.nqueue++];
+		d->id = line[x].u;
+		d->sx = (line[x].fg & 0xffff) * cw;
+		d->sy = (line[x].fg >> 16) * ch;
+		d->dx = borderpx + x * cw;
+		d->dy = xelt_windowmain.paney + y * ch;
+		d->w = n * cw;
+		d->h = ch;
+	}
+}
+
+/*
+ * Decode the PNG file of img into out, w x h pixels of BGRA. 0 when it
+ * is broken. Translucent pixels are blended on the background colour:
+ * like sixel ones, compositing the pixels again where they are drawn
+ * already, under the cursor, changes nothing.
+ */
+int
+ximagepng(const xelt_Image *img, xelt_uchar *out)
+{
+	XRenderColor *bg = &dc.col[defaultbg].color;
+	png_image png;
+	size_t i, n = (size_t)img->w * img->h;
+	xelt_uint a;
+
+	memset(&png, 0, sizeof(png));
+	png.version = PNG_IMAGE_VERSION;
+	/* the png is freed by the calls that fail */
+	if (!png_image_begin_read_from_memory(&png, img->data, img->len)) {
+		fprintf(stderr, "Couldn't decode image: %s\n", png.message);
+		return 0;
+	}
+	if (png.width != img->w || png.height != img->h) {
+		png_image_free(&png);
+		return 0;
+	}
+	png.format = PNG_FORMAT_BGRA;
+	if (!png_image_finish_read(&png, NULL, out, 0, NULL)) {
+		fprintf(stderr, "Couldn't decode image: %s\n", png.message);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++, out += 4) {
+		if ((a = out[3]) == 0xff)
+			continue;
+		out[0] = (out[0] * a + (bg->blue >> 8) * (0xff - a)) / 0xff;
+		out[1] = (out[1] * a + (bg->green >> 8) * (0xff - a)) / 0xff;
+		out[2] = (out[2] * a + (bg->red >> 8) * (0xff - a)) / 0xff;
+		out[3] = 0xff;
+	}
+	return 1;
+}
+
+/* Free the least recently drawn images until need more bytes fit */
+void
+ximageevict(size_t need)
+{
+	Display *dpy = xelt_windowmain.display;
+	int i, old;
+
+	while (images.n > 0 && images.bytes + need > imagecachemax) {
+		for (old = 0, i = 1; i < images.n; i++) {
+			if (images.list[i].used < images.list[old].used)
+				old = i;
+		}
+		XRenderFreePicture(dpy, images.list[old].pict);
+		XFreePixmap(dpy, images.list[old].pixmap);
+		images.bytes -= images.list[old].bytes;
+		images.list[old] = images.list[--images.n];
+	}
+}
+
+/*
+ * Decode img and upload it, NULL when it can't be.
+ */
+xelt_ImageEntry *
+ximageupload(const xelt_Image *img)
+{
+	Display *dpy = xelt_windowmain.display;
+	XRenderPictFormat *fmt = XRenderFindStandardFormat(dpy, PictStandardARGB32);
+	const uint32_t *argb = (const uint32_t *)img->data;
+	size_t i, n = (size_t)img->w * img->h;
+	xelt_ImageEntry *e;
+	xelt_uchar *p;
+	Pixmap pixmap;
+	XImage *xi;
+	GC gc;
+
+	if (!fmt)
+		return NULL;
+	p = xmalloc(n * 4);
+	if (img->kind == XELT_IMAGE_PNG) {
+		if (!ximagepng(img, p)) {
+			free(p);
+			return NULL;
+		}
+	} else {
+		/* sixel pixels are opaque or transparent */
+		for (i = 0; i < n; i++) {
+			p[4 * i] = argb[i];
+			p[4 * i + 1] = argb[i] >> 8;
+			p[4 * i + 2] = argb[i] >> 16;
+			p[4 * i + 3] = argb[i] >> 24;
+		}
+	}
+
+	ximageevict(n * 4);
+	pixmap = XCreatePixmap(dpy, xelt_windowmain.id, img->w, img->h, 32);
+	xi = XCreateImage(dpy, xelt_windowmain.vis, 32, ZPixmap, 0, (char *)p,
+			img->w, img->h, 32, 0);
+	xi->byte_order = LSBFirst;
+	gc = XCreateGC(dpy, pixmap, 0, NULL);
+	XPutImage(dpy, pixmap, gc, xi, 0, 0, 0, 0, img->w, img->h);
+	XFreeGC(dpy, gc);
+	/* frees p */
+	XDestroyImage(xi);
+
+	images.list = xrealloc(images.list, (images.n + 1) * sizeof(*images.list));
+	e = &images.list[images.n++];
+	e->id = img->id;
+	e->pixmap = pixmap;
+	e->pict = XRenderCreatePicture(dpy, pixmap, fmt, 0, NULL);
+	e->cw = e->ch = 0;
+	e->bytes = n * 4;
+	images.bytes += e->bytes;
+	return e;
+}
+
+/*
+ * Scale the picture of e to the cells of the font: its transform maps
+ * pixels of the back buffer to pixels of the image.
+ */
+void
+ximagescale(xelt_ImageEntry *e)
+{
+	const xelt_Image *img = timage(e->id);
+	XTransform t;
+	double sx, sy;
+
+	e->cw = xelt_windowmain.charwidth;
+	e->ch = xelt_windowmain.charheight;
+	/* dropped by the core, the scale stays */
+	if (!img)
+		return;
+	sx = (double)img->w * img->cw / ((double)img->dw * e->cw);
+	sy = (double)img->h * img->ch / ((double)img->dh * e->ch);
+
+	memset(&t, 0, sizeof(t));
+	t.matrix[0][0] = XDoubleToFixed(sx);
+	t.matrix[1][1] = XDoubleToFixed(sy);
+	t.matrix[2][2] = XDoubleToFixed(1);
+	XRenderSetPictureTransform(xelt_windowmain.display, e->pict, &t);
+	XRenderSetPictureFilter(xelt_windowmain.display, e->pict,
+			(sx == 1 && sy == 1) ? FilterNearest : FilterBilinear,
+			NULL, 0);
+}
+
+/*
+ * Image id scaled to the cells, uploaded now when it isn't. NULL once
+ * the core dropped it or when it can't be decoded.
+ */
+xelt_ImageEntry *
+ximageget(uint32_t id)
+{
+	const xelt_Image *img;
+	xelt_ImageEntry *e = NULL;
+	int i;
+
+	for (i = 0; i < images.n && !e; i++) {
+		if (images.list[i].id == id)
+			e = &images.list[i];
+	}
+	if (!e && (!(img = timage(id)) || !(e = ximageupload(img))))
+		return NULL;
+	if (e->cw != xelt_windowmain.charwidth
+			|| e->ch != xelt_windowmain.charheight)
+		ximagescale(e);
+	e->used = images.clock;
+	return e;
+}
+
+/*
+ * Composite the queued image cells over the rows drawn on the back
+ * buffer.
+ */
+void
+ximageflush(void)
+{
+	Display *dpy = xelt_windowmain.display;
+	xelt_ImageEntry *e;
+	xelt_ImageDraw *d;
+	Picture dst;
+	int i;
+
+	if (images.nqueue == 0)
+		return;
+	images.clock++;
+	dst = XRenderCreatePicture(dpy, xelt_windowmain.drawbuf,
+			XRenderFindVisualFormat(dpy, xelt_windowmain.vis), 0, NULL);
+	for (i = 0; i < images.nqueue; i++) {
+		d = &images.queue[i];
+		/* composited at once, a later upload may free it */
+		if ((e = ximageget(d->id))) {
+			XRenderComposite(dpy, PictOpOver, e->pict, None, dst,
+					d->sx, d->sy, 0, 0, d->dx, d->dy, d->w, d->h);
+		}
+	}
+	XRenderFreePicture(dpy, dst);
+	images.nqueue = 0;
+}
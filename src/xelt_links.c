@@ -0,0 +1,336 @@
+/*
+ * Links: URLs and file:line references found on the screen of the
+ * focused pane, and the OSC 8 hyperlinks of any pane.
+ *
+ * The link under the pointer is underlined, linkmod+click opens it with
+ * openurl or openfile of config.h. An OSC 8 link is the id the core
+ * keeps in the cell, see tlinkuri(). The others are found by reading
+ * the row: each row keeps the columns of its links and is read again
+ * only after it was drawn dirty, when the pointer or a click needs it.
+ */
+
+void
+xlinkfree(void)
+{
+	int y;
+
+	for (y = 0; y < links.nrows; y++)
+		free(links.rows[y].span);
+	free(links.rows);
+	free(links.text);
+	links.rows = NULL;
+	links.text = NULL;
+	links.nrows = links.ncols = 0;
+	links.screen = NULL;
+	links.hovery = -1;
+	links.hoverid = 0;
+}
+
+/*
+ * The rows of the loaded terminal, new and unread after a change of
+ * pane, screen or size.
+ */
+void
+xlinkindex(void)
+{
+	int y;
+
+	if (links.screen == terminal.line && links.nrows == terminal.row
+			&& links.ncols == terminal.col)
+		return;
+	xlinkfree();
+	links.rows = xmalloc(terminal.row * sizeof(*links.rows));
+	for (y = 0; y < terminal.row; y++) {
+		/* links are two columns apart at least */
+		links.rows[y].span = xmalloc((terminal.col / 2 + 1) * 3
+				* sizeof(*links.rows[y].span));
+		links.rows[y].valid = 0;
+	}
+	links.text = xmalloc(terminal.col);
+	links.nrows = terminal.row;
+	links.ncols = terminal.col;
+	links.screen = terminal.line;
+}
+
+/*
+ * Rows y1 to y2 of the focused pane are drawn, the dirty ones have to be
+ * read again.
+ */
+void
+xlinkrows(int y1, int y2)
+{
+	int y;
+
+	xlinkindex();
+	for (y = y1; y < y2; y++) {
+		if (!terminal.dirty[y])
+			continue;
+		links.rows[y].valid = 0;
+		if (y == links.hovery)
+			links.hovery = -1;
+	}
+}
+
+/*
+ * Add the link t[x1..x2] of row r unless a URL found before covers it.
+ */
+void
+xlinkadd(xelt_LinkRow *r, int x1, int x2, int kind)
+{
+	int i;
+
+	for (i = 0; i < r->nspan; i++) {
+		if (x1 <= r->span[3 * i + 1] && x2 >= r->span[3 * i])
+			return;
+	}
+	r->span[3 * r->nspan] = x1;
+	r->span[3 * r->nspan + 1] = x2;
+	r->span[3 * r->nspan + 2] = kind;
+	r->nspan++;
+}
+
+/*
+ * Find the links of row y. The row is read as one byte per column,
+ * characters out of ASCII are 0x80: they may be in a URL, not in a path.
+ */
+void
+xlinkrow(int y)
+{
+	xelt_LinkRow *r = &links.rows[y];
+	xelt_Line line = terminal.line[y];
+	xelt_uchar *t = (xelt_uchar *)links.text, c, o;
+	int x, i, s, e, n, col = terminal.col;
+
+	tlinetouch(line);
+	for (x = 0; x < col; x++) {
+		t[x] = (GLYPHRUNE(line[x]) < 0x80
+				&& !(line[x].mode & XELT_ATTR_WDUMMY)) ?
+			GLYPHRUNE(line[x]) : 0x80;
+	}
+	r->nspan = 0;
+
+	/*
+	 * scheme://... up to a blank or a quote, without the punctuation
+	 * ending a sentence
+	 */
+	for (x = 1; x + 3 < col; x++) {
+		if (t[x] != ':' || t[x+1] != '/' || t[x+2] != '/')
+			continue;
+		for (s = x; s > 0 && (isalnum(t[s-1]) || strchr("+.-", t[s-1])); s--)
+			;
+		if (s == x || !isalpha(t[s]))
+			continue;
+		for (e = x + 3; e < col && t[e] > ' ' && t[e] != 0x7f
+				&& !strchr("\"'<>`", t[e]); e++)
+			;
+		for (; e > x + 3; e--) {
+			c = t[e-1];
+			if (strchr(".,;:!?", c))
+				continue;
+			/* a closing bracket without its opening one */
+			if (c == ')' || c == ']' || c == '}') {
+				o = (c == ')') ? '(' : (c == ']') ? '[' : '{';
+				for (n = 0, i = s; i < e; i++)
+					n += (t[i] == c) - (t[i] == o);
+				if (n > 0)
+					continue;
+			}
+			break;
+		}
+		if (e == x + 3)
+			continue;
+		xlinkadd(r, s, e - 1, XELT_LINK_URL);
+		x = e;
+	}
+
+	/* path:line and path:line:column, the path has a '.' or a '/' */
+	for (x = 1; x + 1 < col; x++) {
+		if (t[x] != ':' || !isdigit(t[x+1]))
+			continue;
+		for (s = x, n = 0; s > 0 && (isalnum(t[s-1])
+				|| strchr("._/~+-", t[s-1])); s--)
+			n |= (t[s-1] == '.' || t[s-1] == '/');
+		if (!n)
+			continue;
+		for (e = x + 1; e < col && isdigit(t[e]); e++)
+			;
+		if (e + 1 < col && t[e] == ':' && isdigit(t[e+1])) {
+			for (e++; e < col && isdigit(t[e]); e++)
+				;
+		}
+		xlinkadd(r, s, e - 1, XELT_LINK_FILE);
+		x = e;
+	}
+	r->valid = 1;
+}
+
+/*
+ * Kind of the link found at x, y and its columns, 0 for none.
+ */
+int
+xlinkat(int x, int y, int *x1, int *x2)
+{
+	xelt_LinkRow *r;
+	int i;
+
+	xlinkindex();
+	r = &links.rows[y];
+	if (!r->valid || terminal.dirty[y])
+		xlinkrow(y);
+	for (i = 0; i < r->nspan; i++) {
+		if (BETWEEN(x, r->span[3 * i], r->span[3 * i + 1])) {
+			*x1 = r->span[3 * i];
+			*x2 = r->span[3 * i + 1];
+			return r->span[3 * i + 2];
+		}
+	}
+	return 0;
+}
+
+/* Draw the rows of the link under the pointer again */
+void
+xlinkdirty(void)
+{
+	if (links.hoverid)
+		tfulldirt();
+	else if (links.hovery >= 0)
+		tsetdirt(links.hovery, links.hovery);
+}
+
+/*
+ * The pointer moved to px, py: underline the link under it.
+ */
+void
+xlinkhover(int px, int py)
+{
+	int x, y, id = 0, hy = -1, x1 = 0, x2 = 0;
+
+	if (xpaneat(py) == panes.cur) {
+		x = x2col(px);
+		y = y2row(py);
+		tlinetouch(terminal.line[y]);
+		id = terminal.line[y][x].link;
+		if (!id && xlinkat(x, y, &x1, &x2))
+			hy = y;
+	}
+	if (id == links.hoverid && hy == links.hovery
+			&& (hy < 0 || x1 == links.hoverx1))
+		return;
+
+	xlinkdirty();
+	links.hoverid = id;
+	links.hovery = hy;
+	links.hoverx1 = x1;
+	links.hoverx2 = x2;
+	xlinkdirty();
+}
+
+/*
+ * Underline g, the glyph at x, y, when it is in the link under the
+ * pointer.
+ */
+void
+xlinkglyph(xelt_Glyph *g, int x, int y)
+{
+	if (!links.drawing)
+		return;
+	if (links.hoverid ? g->link == links.hoverid : (y == links.hovery
+				&& BETWEEN(x, links.hoverx1, links.hoverx2)))
+		g->mode |= XELT_ATTR_UNDERLINE;
+}
+
+/*
+ * Run cmd followed by the words of arg, NULL terminated, in its own
+ * session.
+ */
+void
+xlinkspawn(char **cmd, char **arg)
+{
+	char *argv[32];
+	int n = 0;
+
+	while (*cmd && n < LEN(argv) - 1)
+		argv[n++] = *cmd++;
+	while (*arg && n < LEN(argv) - 1)
+		argv[n++] = *arg++;
+	argv[n] = NULL;
+
+	switch (fork()) {
+	case -1:
+		fprintf(stderr, "fork failed: %s\n", strerror(errno));
+		return;
+	case 0:
+		close(ConnectionNumber(xelt_windowmain.display));
+		setsid();
+		execvp(argv[0], argv);
+		fprintf(stderr, "execvp %s failed: %s\n", argv[0], strerror(errno));
+		_exit(1);
+	}
+}
+
+/*
+ * Open the link at the pixel px, py of the focused pane. Returns 0 when
+ * there is none.
+ */
+int
+xlinkopen(int px, int py)
+{
+	char dir[PATH_MAX], proc[32], *text, *file, *path, *home, *p;
+	char *arg[3] = { NULL };
+	int x = x2col(px), y = y2row(py), x1, x2, kind;
+	const char *uri;
+	ssize_t len;
+
+	tlinetouch(terminal.line[y]);
+	if ((uri = tlinkuri(terminal.line[y][x].link))) {
+		arg[0] = (char *)uri;
+		xlinkspawn(openurl, arg);
+		return 1;
+	}
+	if (!(kind = xlinkat(x, y, &x1, &x2)))
+		return 0;
+
+	p = text = xmalloc((x2 - x1 + 1) * XELT_SIZE_UTF + 1);
+	for (x = x1; x <= x2; x++) {
+		if (!(terminal.line[y][x].mode & XELT_ATTR_WDUMMY))
+			p += utf8encode(GLYPHRUNE(terminal.line[y][x]), p);
+	}
+	*p = '\0';
+
+	if (kind == XELT_LINK_URL) {
+		arg[0] = text;
+		xlinkspawn(openurl, arg);
+		free(text);
+		return 1;
+	}
+
+	/* the path has no ':', the line follows the first one */
+	p = strchr(text, ':');
+	*p++ = '\0';
+	arg[1] = p;
+	if ((p = strchr(p, ':')))
+		*p = '\0';
+
+	/* ~/ is in the home, a relative path in the directory of the shell */
+	file = text;
+	dir[0] = '\0';
+	if (text[0] == '~' && text[1] == '/' && (home = getenv("HOME"))) {
+		snprintf(dir, sizeof(dir), "%s", home);
+		file = text + 2;
+	} else if (text[0] != '/' && ttypid()) {
+		snprintf(proc, sizeof(proc), "/proc/%d/cwd", (int)ttypid());
+		if ((len = readlink(proc, dir, sizeof(dir) - 1)) < 0)
+			len = 0;
+		dir[len] = '\0';
+	}
+	path = NULL;
+	if (dir[0]) {
+		path = xmalloc(strlen(dir) + strlen(file) + 2);
+		sprintf(path, "%s/%s", dir, file);
+	}
+	arg[0] = path ? path : text;
+	xlinkspawn(openfile, arg);
+	free(path);
+	free(text);
+	return 1;
+}
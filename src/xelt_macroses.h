@@ -10,7 +10,8 @@
 #define ISCONTROLC0(c)		(BETWEEN(c, 0, 0x1f) || (c) == '\177')
 #define ISCONTROLC1(c)		(BETWEEN(c, 0x80, 0x9f))
 #define ISCONTROL(c)		(ISCONTROLC0(c) || ISCONTROLC1(c))
-#define ISDELIM(u)		(utf8strchr(worddelimiters, u) != NULL)
+#define ISDELIM(u)		isdelim(u)
+#define GLYPHRUNE(g)		(((g).mode & XELT_ATTR_IMAGE) ? ' ' : (g).u)
 #define LIMIT(x, a, b)		(x) = (x) < (a) ? (a) : (x) > (b) ? (b) : (x)
 #define USE_ARGB (alpha != XELT_SIZE_OPAQUE && opt_embed == NULL)
 #define ATTRCMP(a, b)		((a).mode != (b).mode || (a).fg != (b).fg || \
@@ -38,11 +39,11 @@ snprintf(charbuf256, 256 "%s%s", "text1: ", "text2");
 xelt_log(me,charbuf256);
 */
 #if   defined(xelt_log_messages)
-	void xelt_log(char *argStr1,char *argStr2)
+	static inline void xelt_log(char *argStr1,char *argStr2)
 	{
 		printf("%s: %s\n",argStr1,argStr2);
 	}
 #else
-	void xelt_log(char *argStr1,char *argStr2)
+	static inline void xelt_log(char *argStr1,char *argStr2)
 	{}	
 #endif
\ No newline at end of file
@@ -0,0 +1,228 @@
+/*
+ * Panes: several terminals in one window, each with its own tty.
+ *
+ * The core keeps one terminal in its globals, the others are saved in
+ * their pane and swapped in with xpaneload() to be read or drawn, the
+ * output of a shell is parsed once. Between two swaps the focused pane
+ * is loaded, so input and the event handlers see it. Panes share the
+ * window, the fonts and the glyph caches.
+ *
+ * Panes are stacked at full width with a separator row between them.
+ * In tabs mode the focused pane alone fills the window.
+ */
+
+void
+xpaneinit(void)
+{
+	panes.list = xmalloc(sizeof(*panes.list));
+	memset(panes.list, 0, sizeof(*panes.list));
+	panes.list[0].fd = -1;
+	panes.n = 1;
+	panes.cur = panes.loaded = 0;
+}
+
+/*
+ * Swap pane i into the core globals and draw at its place.
+ */
+void
+xpaneload(int i)
+{
+	xelt_Pane *p = &panes.list[i];
+
+	if (i != panes.loaded) {
+		if (panes.loaded >= 0)
+			tsave(&panes.list[panes.loaded].state);
+		tload(&p->state);
+		panes.loaded = i;
+	}
+	xelt_windowmain.paney = borderpx + p->y * xelt_windowmain.charheight;
+	xelt_windowmain.panebottom = (panes.tabs || i == panes.n - 1) ?
+		xelt_windowmain.height :
+		xelt_windowmain.paney + p->row * xelt_windowmain.charheight;
+}
+
+/*
+ * Share col x row cells of the window between the panes and resize
+ * their terminals and ttys.
+ */
+void
+xpanelayout(int col, int row)
+{
+	xelt_Pane *p;
+	int i, y = 0, rows;
+
+	rows = panes.tabs ? row : MAX(row - (panes.n - 1), panes.n) / panes.n;
+	for (i = 0; i < panes.n; i++) {
+		p = &panes.list[i];
+		p->y = panes.tabs ? 0 : y;
+		p->row = (panes.tabs || i < panes.n - 1) ? rows : MAX(row - y, 1);
+		y += p->row + 1;
+
+		xpaneload(i);
+		tresize(col, p->row);
+		ttyresize(MAX(1, col * xelt_windowmain.charwidth),
+				MAX(1, p->row * xelt_windowmain.charheight));
+		tfulldirt();
+	}
+	xpaneload(panes.cur);
+	panes.sepdirty = 1;
+}
+
+/*
+ * Draw the dirty rows of every shown pane, the focused one last with
+ * the cursor. The core may ask for a frame while parsing, the loaded
+ * pane is the same on return.
+ */
+void
+xpanedraw(void)
+{
+	int i, was = panes.loaded, y;
+
+	if (!panes.tabs) {
+		for (i = 0; i < panes.n; i++) {
+			if (i == panes.cur)
+				continue;
+			xpaneload(i);
+			drawregion(0, 0, terminal.col, terminal.row);
+		}
+	}
+	xpaneload(panes.cur);
+	drawregion(0, 0, terminal.col, terminal.row);
+
+	if (!panes.tabs && panes.sepdirty) {
+		for (i = 0; i < panes.n - 1; i++) {
+			y = borderpx + (panes.list[i].y + panes.list[i].row)
+				* xelt_windowmain.charheight;
+			xclear(borderpx, y, borderpx + terminal.col
+					* xelt_windowmain.charwidth,
+					y + xelt_windowmain.charheight);
+			xdrawrect(&dc.col[defaultfg], borderpx,
+					y + xelt_windowmain.charheight / 2,
+					terminal.col * xelt_windowmain.charwidth, 1);
+		}
+	}
+	panes.sepdirty = 0;
+	xpaneload(was);
+}
+
+/*
+ * Move the keyboard focus to pane i. Both panes are redrawn, the cursor
+ * moves and in tabs mode the window shows the other pane.
+ */
+void
+xpaneselect(int i)
+{
+	if (i == panes.cur)
+		return;
+	xpaneload(panes.cur);
+	tfulldirt();
+	panes.cur = i;
+	xpaneload(i);
+	tfulldirt();
+	panes.sepdirty = 1;
+}
+
+/*
+ * Pane at the pixel row y of the window, a separator belongs to the
+ * pane above it.
+ */
+int
+xpaneat(int y)
+{
+	int i, row = (y - borderpx) / xelt_windowmain.charheight;
+
+	if (panes.tabs)
+		return panes.cur;
+	for (i = 0; i < panes.n - 1; i++) {
+		if (row <= panes.list[i].y + panes.list[i].row)
+			return i;
+	}
+	return panes.n - 1;
+}
+
+/* xelt_TermCallbacks.ttyclosed, the shell of the loaded pane is gone */
+void
+xpaneclosed(void)
+{
+	panes.list[panes.loaded].closed = 1;
+}
+
+/*
+ * Free pane i and give its place to the others, the window closes
+ * with the last.
+ */
+void
+xpaneclose(int i)
+{
+	int stat;
+
+	xpaneload(i);
+	/* without -d, xelt ends with the status of the last shell */
+	if (panes.n == 1 && frames.sock < 0) {
+		stat = ttystatus();
+		if (!WIFEXITED(stat) || WEXITSTATUS(stat))
+			printAndExit("child finished with error '%d'\n", stat);
+	}
+	tfree();
+	panes.loaded = -1;
+	memmove(&panes.list[i], &panes.list[i + 1],
+			(panes.n - i - 1) * sizeof(*panes.list));
+	if (--panes.n == 0) {
+		xframeclose();
+		return;
+	}
+	if (panes.cur > i || panes.cur == panes.n)
+		panes.cur--;
+	xpaneload(panes.cur);
+	cresize(0, 0);
+	redraw();
+}
+
+/* SIGHUP to the shell of every pane */
+void
+xpanehangup(void)
+{
+	int i;
+
+	for (i = 0; i < panes.n; i++) {
+		xpaneload(i);
+		ttyhangup();
+	}
+	xpaneload(panes.cur);
+}
+
+void
+panenew(const xelt_Arg *arg)
+{
+	xelt_Pane *p;
+	int col = terminal.col;
+
+	/* no panes on a serial line or while replaying */
+	if (opt_line || panes.list[panes.cur].fd < 0)
+		return;
+
+	tsave(&panes.list[panes.loaded].state);
+	panes.list = xrealloc(panes.list, (panes.n + 1) * sizeof(*panes.list));
+	p = &panes.list[panes.n];
+	memset(p, 0, sizeof(*p));
+	panes.loaded = panes.cur = panes.n++;
+
+	tnew(col, 1, NULL);
+	p->fd = ttynew(NULL, NULL, panes.dir, opt_cmd);
+	cresize(0, 0);
+	redraw();
+}
+
+void
+panefocus(const xelt_Arg *arg)
+{
+	xpaneselect((panes.cur + arg->i + panes.n) % panes.n);
+}
+
+void
+panetabs(const xelt_Arg *arg)
+{
+	panes.tabs = !panes.tabs;
+	cresize(0, 0);
+	redraw();
+}
@@ -0,0 +1,87 @@
+/*
+ * Render benchmark, xelt -B capture.
+ *
+ * A capture made with xelt -r is replayed as fast as possible, every
+ * record (one ttyread() of the session) being followed by one frame:
+ * draw() and an XSync(), so the frame time includes the work of the
+ * server. No shell is started. Meant to be run against a local Xvfb,
+ * the result is printed on stdout once the capture is replayed.
+ */
+
+static double *benchframes;
+static int benchnframes, benchmaxframes;
+
+int
+xrenderbenchcmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+void
+xrenderbenchframe(void)
+{
+	Display *dpy = xelt_windowmain.display;
+	struct timespec start, end;
+
+	/* frames held by a synchronized update aren't drawn at all */
+	if (xsynchold())
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	draw();
+	XSync(dpy, False);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (benchnframes == benchmaxframes) {
+		benchmaxframes = benchmaxframes ? benchmaxframes * 2 : 1024;
+		benchframes = xrealloc(benchframes,
+				benchmaxframes * sizeof(*benchframes));
+	}
+	benchframes[benchnframes++] = (end.tv_sec - start.tv_sec) * 1E3
+		+ (end.tv_nsec - start.tv_nsec) / 1E6;
+}
+
+void
+xrenderbench(char *path)
+{
+	Display *dpy = xelt_windowmain.display;
+	XEvent ev;
+	double total = 0;
+	long len;
+	int i;
+
+	selinit();
+	xmapwait();
+	XSync(dpy, False);
+	while (XPending(dpy)) {
+		XNextEvent(dpy, &ev);
+		xframeevent(&ev);
+	}
+	/* the drawing is what is measured, even when obscured */
+	xelt_windowmain.state |= XELT_WIN_VISIBLE;
+	memset(&rstats, 0, sizeof(rstats));
+
+	if ((len = treplay(path, 0, xrenderbenchframe)) < 0)
+		printAndExit("Couldn't open %s: %s\n", path, strerror(errno));
+	if (!benchnframes)
+		printAndExit("Nothing to replay in %s\n", path);
+
+	qsort(benchframes, benchnframes, sizeof(*benchframes), xrenderbenchcmp);
+	for (i = 0; i < benchnframes; i++)
+		total += benchframes[i];
+
+	printf("renderer        %s, %d draw threads\n",
+			shmimg.active ? "shm" : "xft", drawpool.nthreads);
+	printf("bytes           %ld\n", len);
+	printf("frames          %d\n", benchnframes);
+	printf("frame p50       %.3f ms\n", benchframes[benchnframes / 2]);
+	printf("frame p99       %.3f ms\n", benchframes[benchnframes * 99 / 100]);
+	printf("frame max       %.3f ms\n", benchframes[benchnframes - 1]);
+	printf("total           %.1f ms\n", total);
+	printf("requests/frame  %.1f\n", (double)rstats.requests / MAX(rstats.frames, 1));
+	printf("glyph misses    %lu\n", rstats.glyphmisses);
+	printf("font loads      %lu\n", rstats.fontloads);
+	printf("colour allocs   %lu\n", rstats.colorallocs);
+	free(benchframes);
+}
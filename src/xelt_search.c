@@ -0,0 +1,275 @@
+/*
+ * Incremental search of the focused pane, Alt+Shift+F.
+ *
+ * The query is typed in a bar at the bottom of the window and every
+ * match on the screen is highlighted as it grows. Return and Down move
+ * to the next match, Shift+Return and Up to the previous one, Escape or
+ * Alt+Shift+F leave. Matching ignores the case.
+ *
+ * Each row keeps its text as searched, folded UTF-8 with the column of
+ * every byte, and its matches. A row is read and matched again only
+ * when it is drawn dirty or the query changes; a match is a memchr()
+ * for the first byte of the query and a memcmp().
+ */
+
+void
+searchtoggle(const xelt_Arg *arg)
+{
+	if (search.active) {
+		xsearchend();
+		return;
+	}
+	search.active = 1;
+	search.qlen = 0;
+	xsearchrequery();
+}
+
+void
+xsearchfree(void)
+{
+	int y;
+
+	for (y = 0; y < search.nrows; y++) {
+		free(search.rows[y].text);
+		free(search.rows[y].col);
+		free(search.rows[y].match);
+	}
+	free(search.rows);
+	search.rows = NULL;
+	search.nrows = search.ncols = 0;
+	search.screen = NULL;
+}
+
+/* Every row is matched again and the current match picked again */
+void
+xsearchrequery(void)
+{
+	int y;
+
+	for (y = 0; y < search.nrows; y++)
+		search.rows[y].valid = 0;
+	search.cury = -1;
+	tfulldirt();
+}
+
+void
+xsearchend(void)
+{
+	search.active = 0;
+	search.cury = -1;
+	/* the bar may cover several panes */
+	redraw();
+}
+
+/*
+ * Key typed while searching, none goes to the shell.
+ */
+void
+xsearchkey(KeySym ksym, xelt_uint state, char *buf, int len)
+{
+	xelt_CharCode u;
+	size_t n;
+	char *p;
+
+	switch (ksym) {
+	case XK_Escape:
+		xsearchend();
+		return;
+	case XK_Return:
+	case XK_KP_Enter:
+		xsearchjump((state & ShiftMask) ? -1 : +1);
+		return;
+	case XK_Up:
+		xsearchjump(-1);
+		return;
+	case XK_Down:
+		xsearchjump(+1);
+		return;
+	case XK_BackSpace:
+		/* the last character, with its continuation bytes */
+		while (search.qlen > 0
+				&& (search.query[--search.qlen] & 0xC0) == 0x80)
+			;
+		break;
+	default:
+		if (len == 0 || (state & ControlMask)
+				|| (xelt_uchar)buf[0] < 0x20 || buf[0] == 0x7f)
+			return;
+		for (p = buf; p < buf + len; p += n) {
+			if (!(n = utf8decode(p, &u, buf + len - p)))
+				break;
+			if (search.qlen + XELT_SIZE_UTF >= (int)sizeof(search.query))
+				break;
+			search.qlen += utf8encode(towlower(u),
+					search.query + search.qlen);
+		}
+		break;
+	}
+	xsearchrequery();
+}
+
+/*
+ * Read row y of the loaded terminal and find the query in it.
+ */
+void
+xsearchrow(int y)
+{
+	xelt_SearchRow *r = &search.rows[y];
+	xelt_Line line = terminal.line[y];
+	char *p;
+	int x, x2, i, n, ofs, last;
+
+	tlinetouch(line);
+	r->len = 0;
+	for (x = 0; x < terminal.col; x++) {
+		if (line[x].mode & XELT_ATTR_WDUMMY)
+			continue;
+		n = utf8encode(towlower(GLYPHRUNE(line[x])), r->text + r->len);
+		for (i = 0; i < n; i++)
+			r->col[r->len++] = x;
+	}
+
+	r->nmatch = 0;
+	last = r->len - search.qlen;
+	for (ofs = 0; search.qlen > 0 && ofs <= last; ofs++) {
+		p = memchr(r->text + ofs, search.query[0], last - ofs + 1);
+		if (!p)
+			break;
+		ofs = p - r->text;
+		if (memcmp(p, search.query, search.qlen))
+			continue;
+		x2 = r->col[ofs + search.qlen - 1];
+		if (line[x2].mode & XELT_ATTR_WIDE)
+			x2++;
+		r->match[2 * r->nmatch] = r->col[ofs];
+		r->match[2 * r->nmatch + 1] = x2;
+		r->nmatch++;
+		ofs += search.qlen - 1;
+	}
+	r->valid = 1;
+}
+
+/*
+ * Bring the rows y1 to y2 of the focused pane up to date before they
+ * are drawn, the dirty ones have changed.
+ */
+void
+xsearchrows(int y1, int y2)
+{
+	xelt_SearchRow *r;
+	int y;
+
+	/* another pane, the other screen or a new size */
+	if (search.screen != terminal.line || search.nrows != terminal.row
+			|| search.ncols != terminal.col) {
+		xsearchfree();
+		search.rows = xmalloc(terminal.row * sizeof(*search.rows));
+		for (y = 0; y < terminal.row; y++) {
+			r = &search.rows[y];
+			r->text = xmalloc(terminal.col * XELT_SIZE_UTF);
+			r->col = xmalloc(terminal.col * XELT_SIZE_UTF * sizeof(*r->col));
+			r->match = xmalloc(terminal.col * 2 * sizeof(*r->match));
+			r->valid = 0;
+		}
+		search.nrows = terminal.row;
+		search.ncols = terminal.col;
+		search.screen = terminal.line;
+		search.cury = -1;
+		tfulldirt();
+	}
+
+	for (y = y1; y < y2; y++) {
+		if (terminal.dirty[y] || !search.rows[y].valid)
+			xsearchrow(y);
+	}
+
+	/* the last match is the current one until the user moves */
+	if (search.cury >= 0
+			&& search.curi < search.rows[search.cury].nmatch)
+		return;
+	search.cury = -1;
+	for (y = search.nrows - 1; y >= 0; y--) {
+		if (search.rows[y].nmatch) {
+			search.cury = y;
+			search.curi = search.rows[y].nmatch - 1;
+			tsetdirt(y, y);
+			break;
+		}
+	}
+}
+
+/*
+ * Colour g, the glyph at x, y, as a match when it is one.
+ */
+void
+xsearchglyph(xelt_Glyph *g, int x, int y)
+{
+	xelt_SearchRow *r;
+	int i;
+
+	if (!search.drawing || y >= search.nrows)
+		return;
+	r = &search.rows[y];
+	for (i = 0; i < r->nmatch && x >= r->match[2 * i]; i++) {
+		if (x <= r->match[2 * i + 1]) {
+			g->fg = searchfg;
+			g->bg = (y == search.cury && i == search.curi) ?
+				searchcurbg : searchbg;
+			g->mode &= ~XELT_ATTR_REVERSE;
+			return;
+		}
+	}
+}
+
+/*
+ * Make the next match, dir rows down, the current one. It wraps at the
+ * top and the bottom of the screen.
+ */
+void
+xsearchjump(int dir)
+{
+	int y, i, n;
+
+	if (search.cury < 0)
+		return;
+	tsetdirt(search.cury, search.cury);
+	y = search.cury;
+	i = search.curi + dir;
+	for (n = 0; n <= search.nrows; n++) {
+		if (i >= 0 && i < search.rows[y].nmatch)
+			break;
+		y = (y + dir + search.nrows) % search.nrows;
+		i = (dir > 0) ? 0 : search.rows[y].nmatch - 1;
+	}
+	search.cury = y;
+	search.curi = i;
+	tsetdirt(y, y);
+}
+
+/*
+ * The query and the position of the current match among all, over the
+ * last row of the window.
+ */
+void
+xsearchbar(void)
+{
+	char buf[XELT_SIZE_SEARCH + 64];
+	int len, y, i, n = 0, k = 0;
+
+	for (y = 0; y < search.nrows; y++) {
+		if (y < search.cury)
+			k += search.rows[y].nmatch;
+		n += search.rows[y].nmatch;
+	}
+	if (search.cury >= 0)
+		k += search.curi + 1;
+	len = snprintf(buf, sizeof(buf), "search: %.*s   %d/%d",
+			search.qlen, search.query, k, n);
+
+	i = xelt_windowmain.height - borderpx - xelt_windowmain.charheight;
+	XftDrawRect(xelt_windowmain.draw, &dc.col[defaultfg], 0, i,
+			xelt_windowmain.width, xelt_windowmain.height - i);
+	XftDrawStringUtf8(xelt_windowmain.draw, &dc.col[defaultbg],
+			dc.font.match, borderpx, i + dc.font.ascent,
+			(FcChar8 *)buf, len);
+}
@@ -0,0 +1,457 @@
+/*
+ * MIT-SHM software rasterizer.
+ *
+ * Glyphs are rendered with FreeType into a client side XImage which
+ * lives in a shared memory segment. Only the damaged pixel rows are
+ * pushed with XShmPutImage, so a frame costs no per glyph X protocol.
+ * Used on local displays only, xdrawglyphfontspecs() falls back to Xft
+ * whenever the segment can not be attached.
+ *
+ * The server reads a segment after XShmPutImage returns: there are two,
+ * the next frame is drawn into the other one while the server reads the
+ * last, and a segment is only written again once its ShmCompletion
+ * event came back, see xshmwait().
+ */
+
+static int shmattachfailed;
+static int shmcompletion;  /* type of the ShmCompletion event */
+
+int
+xshmerror(Display *display, XErrorEvent *e)
+{
+	shmattachfailed = 1;
+	return 0;
+}
+
+void
+xshminit(void)
+{
+	Visual *vis = xelt_windowmain.vis;
+	char *name = DisplayString(xelt_windowmain.display);
+
+	if (!shmrender)
+		return;
+
+	/* a shared segment is only reachable through a local connection */
+	if (name[0] != ':' && strncmp(name, "unix:", 5)) {
+		fprintf(stderr, "MIT-SHM: display %s is not local\n", name);
+		return;
+	}
+	if (!XShmQueryExtension(xelt_windowmain.display)) {
+		fprintf(stderr, "MIT-SHM: extension not available\n");
+		return;
+	}
+	if (vis->class != TrueColor || vis->red_mask != 0xff0000
+			|| vis->green_mask != 0xff00 || vis->blue_mask != 0xff) {
+		fprintf(stderr, "MIT-SHM: unsupported visual\n");
+		return;
+	}
+
+	shmcompletion = XShmGetEventBase(xelt_windowmain.display) + ShmCompletion;
+	shmimg.cache = xmalloc(XELT_SIZE_SHM_GLYPHCACHE * sizeof(*shmimg.cache));
+	memset(shmimg.cache, 0, XELT_SIZE_SHM_GLYPHCACHE * sizeof(*shmimg.cache));
+	shmimg.cachelen = 0;
+	shmimg.active = 1;
+	xshmresize();
+}
+
+/*
+ * Attach a new segment s the size of the window, 0 when the server
+ * can't.
+ */
+int
+xshmattach(xelt_ShmSegment *s)
+{
+	XErrorHandler oldhandler;
+	XImage *im;
+
+	im = XShmCreateImage(xelt_windowmain.display, xelt_windowmain.vis,
+			xelt_windowmain.depth, ZPixmap, NULL, &s->info,
+			xelt_windowmain.width, xelt_windowmain.height);
+	if (!im)
+		return 0;
+	if (im->bits_per_pixel != 32) {
+		XDestroyImage(im);
+		return 0;
+	}
+
+	s->info.shmid = shmget(IPC_PRIVATE, im->bytes_per_line * im->height,
+			IPC_CREAT | 0600);
+	if (s->info.shmid < 0) {
+		XDestroyImage(im);
+		return 0;
+	}
+	s->info.shmaddr = im->data = shmat(s->info.shmid, NULL, 0);
+	s->info.readOnly = False;
+	if (s->info.shmaddr == (char *)-1) {
+		shmctl(s->info.shmid, IPC_RMID, NULL);
+		im->data = NULL;
+		XDestroyImage(im);
+		return 0;
+	}
+
+	/* a remote or restricted server answers XShmAttach with an error */
+	shmattachfailed = 0;
+	XSync(xelt_windowmain.display, False);
+	oldhandler = XSetErrorHandler(xshmerror);
+	XShmAttach(xelt_windowmain.display, &s->info);
+	XSync(xelt_windowmain.display, False);
+	XSetErrorHandler(oldhandler);
+
+	/* the segment is destroyed once both sides have detached */
+	shmctl(s->info.shmid, IPC_RMID, NULL);
+	if (shmattachfailed) {
+		shmdt(s->info.shmaddr);
+		im->data = NULL;
+		XDestroyImage(im);
+		return 0;
+	}
+
+	s->image = im;
+	s->serial = 0;
+	return 1;
+}
+
+Bool
+xshmiscompletion(Display *dpy, XEvent *ev, XPointer arg)
+{
+	xelt_ShmSegment *s = (xelt_ShmSegment *)arg;
+
+	return ev->type == shmcompletion
+		&& ((XShmCompletionEvent *)ev)->shmseg == s->info.shmseg
+		&& ev->xany.serial >= s->serial;
+}
+
+/*
+ * Wait until the server is done reading s. Its ShmCompletion is usually
+ * in already, the event loop drops the ones it reads first.
+ */
+void
+xshmwait(xelt_ShmSegment *s)
+{
+	XEvent ev;
+
+	if (s->serial && LastKnownRequestProcessed(xelt_windowmain.display)
+			< s->serial)
+		XIfEvent(xelt_windowmain.display, &ev, xshmiscompletion,
+				(XPointer)s);
+	s->serial = 0;
+}
+
+void
+xshmfree(void)
+{
+	xelt_ShmSegment *s;
+	int i;
+
+	if (!shmimg.image)
+		return;
+
+	for (i = 0; i < LEN(shmimg.seg); i++) {
+		s = &shmimg.seg[i];
+		if (!s->image)
+			continue;
+		xshmwait(s);
+		XShmDetach(xelt_windowmain.display, &s->info);
+		XSync(xelt_windowmain.display, False);
+		/* the data belongs to the segment, XDestroyImage must not free it */
+		s->image->data = NULL;
+		XDestroyImage(s->image);
+		shmdt(s->info.shmaddr);
+		s->image = NULL;
+	}
+	shmimg.image = NULL;
+}
+
+void
+xshmresize(void)
+{
+	int i;
+
+	if (!shmimg.active)
+		return;
+
+	xshmfree();
+	for (i = 0; i < LEN(shmimg.seg); i++) {
+		if (!xshmattach(&shmimg.seg[i]))
+			goto fallback;
+	}
+
+	shmimg.cur = 0;
+	shmimg.image = shmimg.seg[0].image;
+	shmimg.damage = xrealloc(shmimg.damage, shmimg.image->height);
+	memset(shmimg.damage, 0, shmimg.image->height);
+	return;
+
+fallback:
+	fprintf(stderr, "MIT-SHM: can't create shared image, using Xft\n");
+	/* the segments attached are detached */
+	shmimg.image = shmimg.seg[0].image;
+	xshmfree();
+	xshmclearcache();
+	free(shmimg.cache);
+	shmimg.cache = NULL;
+	shmimg.active = 0;
+}
+
+/*
+ * Premultiplied 32 bit pixel of col, the same value XRender stores
+ * for a PictOpSrc fill.
+ */
+uint32_t
+xshmpixel(const xelt_Color *col)
+{
+	uint32_t a = col->color.alpha >> 8;
+
+	return a << 24
+		| ((col->color.red >> 8) * a / 0xff) << 16
+		| ((col->color.green >> 8) * a / 0xff) << 8
+		| ((col->color.blue >> 8) * a / 0xff);
+}
+
+/*
+ * Blend src over dst with coverage a. Two channels are processed per
+ * multiplication (red/blue and alpha/green), which keeps the inner
+ * glyph loop free of per channel work.
+ */
+uint32_t
+xshmblend(uint32_t src, uint32_t dst, uint32_t a)
+{
+	uint32_t rb, ag, na;
+
+	a += a >> 7; /* 0..255 to 0..256 */
+	na = 256 - a;
+	rb = (((src & 0x00ff00ff) * a + (dst & 0x00ff00ff) * na) >> 8)
+		& 0x00ff00ff;
+	ag = (((src >> 8) & 0x00ff00ff) * a + ((dst >> 8) & 0x00ff00ff) * na)
+		& 0xff00ff00;
+
+	return rb | ag;
+}
+
+void
+xshmfillrect(xelt_Color *col, int x, int y, int w, int h)
+{
+	XImage *im = shmimg.image;
+	uint32_t pixel = xshmpixel(col), *row;
+	int i, j;
+
+	if (x < 0)
+		w += x, x = 0;
+	if (y < 0)
+		h += y, y = 0;
+	w = MIN(w, im->width - x);
+	h = MIN(h, im->height - y);
+	if (w <= 0 || h <= 0)
+		return;
+
+	for (j = y; j < y + h; j++) {
+		row = (uint32_t *)(im->data + j * im->bytes_per_line) + x;
+		for (i = 0; i < w; i++)
+			row[i] = pixel;
+		shmimg.damage[j] = 1;
+	}
+}
+
+/*
+ * Composite the glyphs of specs with colour fg, clipped to the cell
+ * rectangle cx, cy, cw, ch.
+ */
+void
+xshmdrawglyphs(xelt_Color *fg, const XftGlyphFontSpec *specs, int len,
+		int cx, int cy, int cw, int ch)
+{
+	XImage *im = shmimg.image;
+	xelt_GlyphBitmap *gb;
+	uint32_t src = xshmpixel(fg), *dst;
+	xelt_uchar *a;
+	int i, x, y, gx, gy, x1, x2, y1, y2;
+
+	for (i = 0; i < len; i++) {
+		gb = xshmglyph(specs[i].font, specs[i].glyph);
+		if (!gb || !gb->alpha)
+			continue;
+
+		gx = specs[i].x + gb->left;
+		gy = specs[i].y - gb->top;
+		x1 = MAX(MAX(gx, cx), 0);
+		x2 = MIN(MIN(gx + gb->width, cx + cw), im->width);
+		y1 = MAX(MAX(gy, cy), 0);
+		y2 = MIN(MIN(gy + gb->height, cy + ch), im->height);
+
+		for (y = y1; y < y2; y++) {
+			a = gb->alpha + (y - gy) * gb->width + (x1 - gx);
+			dst = (uint32_t *)(im->data + y * im->bytes_per_line) + x1;
+			for (x = x1; x < x2; x++, a++, dst++) {
+				if (*a == 0xff)
+					*dst = src;
+				else if (*a)
+					*dst = xshmblend(src, *dst, *a);
+			}
+			shmimg.damage[y] = 1;
+		}
+	}
+}
+
+/*
+ * Push the damaged pixel rows to the back buffer, one request per run
+ * of consecutive rows, the last one asking for a ShmCompletion. The
+ * next frame is drawn in the other segment, the rows pushed are copied
+ * into it once the server is done with them.
+ */
+void
+xshmflush(void)
+{
+	xelt_ShmSegment *s = &shmimg.seg[shmimg.cur], *next;
+	XImage *im = shmimg.image;
+	int y1, y2, py1 = 0, py2 = 0;
+
+	for (y1 = 0; y1 < im->height; y1 = y2) {
+		if (!shmimg.damage[y1]) {
+			y2 = y1 + 1;
+			continue;
+		}
+		for (y2 = y1; y2 < im->height && shmimg.damage[y2]; y2++)
+			;
+		if (py2 > py1) {
+			XShmPutImage(xelt_windowmain.display, xelt_windowmain.drawbuf,
+					dc.gc, im, 0, py1, 0, py1, im->width,
+					py2 - py1, False);
+		}
+		py1 = y1;
+		py2 = y2;
+	}
+	if (py2 == py1)
+		return;
+	s->serial = NextRequest(xelt_windowmain.display);
+	XShmPutImage(xelt_windowmain.display, xelt_windowmain.drawbuf, dc.gc,
+			im, 0, py1, 0, py1, im->width, py2 - py1, True);
+
+	next = &shmimg.seg[!shmimg.cur];
+	xshmwait(next);
+	for (y1 = 0; y1 < im->height; y1++) {
+		if (!shmimg.damage[y1])
+			continue;
+		memcpy(next->image->data + y1 * im->bytes_per_line,
+				im->data + y1 * im->bytes_per_line,
+				im->bytes_per_line);
+		shmimg.damage[y1] = 0;
+	}
+	shmimg.cur = !shmimg.cur;
+	shmimg.image = next->image;
+}
+
+/*
+ * FreeType load flags matching the rendering options Xft uses for font.
+ */
+int
+xshmloadflags(XftFont *font)
+{
+	FcBool antialias = FcTrue, hinting = FcTrue, autohint = FcFalse;
+	int hintstyle = FC_HINT_FULL, flags = FT_LOAD_RENDER;
+
+	FcPatternGetBool(font->pattern, FC_ANTIALIAS, 0, &antialias);
+	FcPatternGetBool(font->pattern, FC_HINTING, 0, &hinting);
+	FcPatternGetBool(font->pattern, FC_AUTOHINT, 0, &autohint);
+	FcPatternGetInteger(font->pattern, FC_HINT_STYLE, 0, &hintstyle);
+
+	if (!antialias)
+		flags |= FT_LOAD_MONOCHROME | FT_LOAD_TARGET_MONO;
+	else if (!hinting || hintstyle == FC_HINT_NONE)
+		flags |= FT_LOAD_NO_HINTING;
+	else if (hintstyle == FC_HINT_SLIGHT)
+		flags |= FT_LOAD_TARGET_LIGHT;
+	if (autohint)
+		flags |= FT_LOAD_FORCE_AUTOHINT;
+
+	return flags;
+}
+
+/*
+ * Cached coverage bitmap of glyph in font. Fonts are closed on zoom,
+ * so xunloadfonts() clears the cache before a pointer can be reused.
+ */
+xelt_GlyphBitmap *
+xshmglyph(XftFont *font, FT_UInt glyph)
+{
+	xelt_GlyphBitmap *gb;
+	FT_Face face;
+	FT_Bitmap *bm;
+	xelt_uchar *src;
+	xelt_uint i;
+	int x, y;
+
+	i = ((uintptr_t)font >> 4 ^ glyph * 2654435761u)
+		& (XELT_SIZE_SHM_GLYPHCACHE - 1);
+	for (gb = &shmimg.cache[i]; gb->font; gb = &shmimg.cache[i]) {
+		if (gb->font == font && gb->glyph == glyph)
+			return gb;
+		i = (i + 1) & (XELT_SIZE_SHM_GLYPHCACHE - 1);
+	}
+
+	/* keep the probe sequences short, start over when 3/4 full */
+	if (shmimg.cachelen >= XELT_SIZE_SHM_GLYPHCACHE / 4 * 3) {
+		xshmclearcache();
+		return xshmglyph(font, glyph);
+	}
+
+	if (!(face = XftLockFace(font)))
+		return NULL;
+
+	gb->font = font;
+	gb->glyph = glyph;
+	gb->width = gb->height = 0;
+	gb->alpha = NULL;
+	shmimg.cachelen++;
+
+	/* a glyph which fails to load is cached empty */
+	if (FT_Load_Glyph(face, glyph, xshmloadflags(font))) {
+		XftUnlockFace(font);
+		return gb;
+	}
+
+	bm = &face->glyph->bitmap;
+	gb->width = bm->width;
+	gb->height = bm->rows;
+	gb->left = face->glyph->bitmap_left;
+	gb->top = face->glyph->bitmap_top;
+	if (gb->width > 0 && gb->height > 0)
+		gb->alpha = xmalloc(gb->width * gb->height);
+
+	for (y = 0; y < gb->height; y++) {
+		src = bm->buffer + y * bm->pitch;
+		for (x = 0; x < gb->width; x++) {
+			switch (bm->pixel_mode) {
+			case FT_PIXEL_MODE_MONO:
+				gb->alpha[y * gb->width + x] =
+					(src[x >> 3] & (0x80 >> (x & 7))) ? 0xff : 0;
+				break;
+			case FT_PIXEL_MODE_BGRA: /* colour glyphs, keep the shape */
+				gb->alpha[y * gb->width + x] = src[4 * x + 3];
+				break;
+			default:
+				gb->alpha[y * gb->width + x] = src[x];
+				break;
+			}
+		}
+	}
+	XftUnlockFace(font);
+
+	return gb;
+}
+
+void
+xshmclearcache(void)
+{
+	int i;
+
+	if (!shmimg.cache)
+		return;
+
+	for (i = 0; i < XELT_SIZE_SHM_GLYPHCACHE; i++) {
+		free(shmimg.cache[i].alpha);
+		shmimg.cache[i].alpha = NULL;
+		shmimg.cache[i].font = NULL;
+	}
+	shmimg.cachelen = 0;
+}
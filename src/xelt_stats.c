@@ -0,0 +1,96 @@
+/*
+ * Counters overlay and dump.
+ *
+ * termstats (core) and rstats (rendering) are always counted. The
+ * overlay, toggled by togglestats(), is drawn over the top right corner
+ * of every frame. SIGUSR1 prints the same on stderr.
+ */
+
+int
+xstatsformat(char *buf, size_t size)
+{
+	return snprintf(buf, size,
+		"bytes       %lu\n"
+		"csi esc     %lu %lu\n"
+		"osc dcs apc %lu %lu %lu\n"
+		"scrolled    %lu\n"
+		"cells       %lu written, %lu cleared\n"
+		"frames      %lu\n"
+		"rows        %d last, %lu\n"
+		"requests    %d last, %lu\n"
+		"glyph miss  %lu\n"
+		"font loads  %lu\n"
+		"colours     %lu\n"
+		"ttyread     %.1f ms\n"
+		"parser      %.1f ms\n"
+		"draw        %.1f ms\n",
+		termstats.bytes, termstats.csi, termstats.esc,
+		termstats.osc, termstats.dcs, termstats.apc,
+		termstats.scrolled, termstats.cells, termstats.cleared,
+		rstats.frames,
+		rstats.lastrows, rstats.rows,
+		rstats.lastrequests, rstats.requests,
+		rstats.glyphmisses, rstats.fontloads, rstats.colorallocs,
+		termstats.readms, termstats.parsems, rstats.drawms);
+}
+
+void
+xstatsprint(FILE *f)
+{
+	char buf[1024];
+
+	xstatsformat(buf, sizeof(buf));
+	fputs(buf, f);
+}
+
+void
+xstatssignal(int sig)
+{
+	/* printed by run(), stdio isn't safe in a signal handler */
+	statsdump = 1;
+}
+
+void
+togglestats(const xelt_Arg *dummy)
+{
+	statsoverlay = !statsoverlay;
+	/* the cells under the overlay have to come back */
+	if (!statsoverlay)
+		redraw();
+}
+
+/*
+ * Drawn on the back buffer after the rows, in reverse colours.
+ */
+void
+xdrawstats(void)
+{
+	static int width = 0; /* only grows, the box never leaves stale pixels */
+	char buf[1024], *line, *end;
+	int nlines = 0, len, x, y;
+	XGlyphInfo ext;
+	XftFont *font = dc.font.match;
+
+	xstatsformat(buf, sizeof(buf));
+	for (line = buf; (end = strchr(line, '\n')); line = end + 1) {
+		XftTextExtentsUtf8(xelt_windowmain.display, font,
+				(FcChar8 *)line, end - line, &ext);
+		width = MAX(width, ext.xOff);
+		nlines++;
+	}
+
+	x = xelt_windowmain.width - borderpx - width - 2 * xelt_windowmain.charwidth;
+	y = borderpx;
+	XftDrawRect(xelt_windowmain.draw, &dc.col[defaultfg], MAX(x, 0), y,
+			width + 2 * xelt_windowmain.charwidth,
+			(nlines + 1) * xelt_windowmain.charheight);
+
+	x += xelt_windowmain.charwidth;
+	y += xelt_windowmain.charheight / 2 + dc.font.ascent;
+	for (line = buf; (end = strchr(line, '\n')); line = end + 1) {
+		len = end - line;
+		XftDrawStringUtf8(xelt_windowmain.draw, &dc.col[defaultbg],
+				font, MAX(x, 0), y, (FcChar8 *)line, len);
+		y += xelt_windowmain.charheight;
+	}
+}
@@ -0,0 +1,4163 @@
+/* See LICENSE for license details. */
+
+/*
+ * Terminal emulation core: tty handling, escape sequence parser and
+ * screen state. Has no X11 dependency and is built as a static library,
+ * the front end reacts to what it can't do itself through the
+ * xelt_TermCallbacks given to tnew().
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pwd.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#if   defined(__linux)
+	#include <pty.h>
+#elif defined(__OpenBSD__) || defined(__NetBSD__) || defined(__APPLE__)
+	#include <util.h>
+#elif defined(__FreeBSD__) || defined(__DragonFly__)
+	#include <libutil.h>
+#endif
+
+#include "xelt_term.h"
+
+/* Terminal settings, see config.h for the front end ones. */
+#include "config_term.h"
+
+static char charbuf256[256];
+
+static void execsh(char **);
+static void sigchld(int);
+static void stty(char **);
+static void ttyrecput(const char *, size_t);
+static inline uint32_t ttyrecu32(const xelt_uchar *);
+
+static void csidump(void);
+static void csihandle(void);
+static void csiput(xelt_uchar);
+static void csiarg(void);
+static void csiparse(void);
+static void csireset(void);
+static int eschandle(xelt_uchar);
+static void strdump(void);
+static uint32_t tlinkhash(const char *);
+static int tlinkid(char *);
+static void tlinkinsert(int);
+static void tlinksweep(void);
+static void tlinkfree(void);
+static int tbase64put(xelt_CharCode, size_t);
+static void tosc52put(xelt_CharCode);
+static void tosc52end(const char *);
+static void timageput(xelt_CharCode);
+static int timagestart(xelt_CharCode);
+static const xelt_Image *timageadd(int, char *, size_t, int, int, int, int);
+static void timageplace(const xelt_Image *, int);
+static int tsixelgrow(int, int);
+static void tsixelintro(void);
+static uint32_t tsixelhls(int, int, int);
+static void tsixelput(xelt_CharCode);
+static void tsixelend(void);
+static void tinlineend(void);
+static int tinlinesize(const char *, int, int);
+static void strhandle(void);
+static void strparse(void);
+static void strreset(void);
+static int strgrow(size_t);
+
+static void tprinter(char *, size_t);
+static void tdumpline(int);
+static void tclearregion(int, int, int, int);
+static void tdirty(int);
+static void tdeliminit(void);
+static int isdelim(xelt_CharCode);
+static void tfillrow(xelt_Line, int, int, xelt_Glyph);
+static void tfixwide(xelt_Line, int, int);
+static void tmendwide(xelt_Line, int, int);
+static int trect(int *, int *, int *, int *, int *);
+static void tcopyrect(int, int, int, int, int, int);
+static void tfillrect(int, int, int, int, xelt_CharCode);
+static void tsclearregion(int, int, int, int);
+static void tcursor(int);
+static void tdeletechar(int);
+static void tdeleteline(int);
+static void tinsertblank(int);
+static void tinsertblankline(int);
+static int tlinelen(int);
+static void tmoveto(int, int);
+static void tmoveato(int, int);
+static void tnewline(int);
+static void tputtab(int);
+static void tredraw(void);
+static void treset(void);
+static void tscrollup(int, int);
+static void tscrolldown(int, int);
+static void tsgrmode(int, xelt_ushort);
+static void tsgrparam(int, int);
+static void tsgrext(void);
+static void tsgrapply(void);
+static void tsetchar(xelt_CharCode, xelt_Glyph *, int, int);
+static void tsetscroll(int, int);
+static void tsetmargins(int, int);
+static void tscrollcols(int, int);
+static void tswapscreen(void);
+static void tsetmode(int, int, int *, int);
+static int tgetmode(int, int);
+// static void techo(xelt_CharCode);
+static void tcontrolcode(xelt_uchar );
+static void tdectest(char );
+static void tdeftran(char);
+static void tstrsequence(xelt_uchar);
+
+static void selscroll(int, int);
+static void selsnap(int *, int *, int);
+static int selintersect(int, int, int, int);
+
+static xelt_CharCode utf8decodebyte(char, size_t *);
+static char utf8encodebyte(xelt_CharCode, size_t);
+static size_t utf8validate(xelt_CharCode *, size_t);
+
+static double tstatclock(void);
+static void tprofstart(xelt_ProfMark *);
+static void tprofadd(const char *, xelt_ProfMark *);
+static void tprofcsi(xelt_ProfMark *);
+static void tprofesc(xelt_uchar, xelt_ProfMark *);
+static void tprofstr(xelt_ProfMark *);
+static int tprofcmp(const void *, const void *);
+static void tprofreport(void);
+
+/* Globals */
+xelt_Terminal terminal;
+xelt_Selection sel;
+xelt_TermStats termstats;
+static xelt_TermCallbacks termcb;
+static xelt_CSIEscape csiescseq;
+static xelt_STREscape strescseq;
+static int cmdfd = -1; /* no tty while replaying or headless */
+static pid_t pid;
+static FILE *recfile;
+static char ttybuf[BUFSIZ]; /* read from the tty, incomplete UTF-8 left */
+static int ttybuflen;
+static xelt_ProfEntry *proftab; /* NULL unless profiling */
+static xelt_ProfEntry profother;
+static int proflen;
+static char *profpath;
+static int iofd = 1;
+static char *ioname = NULL;
+/* worddelimiters, a bitmap of ASCII and sorted ranges of the others */
+static uint32_t delimascii[128 / 32];
+static xelt_CharCode delimrange[LEN(worddelimiters)][2];
+static int ndelimrange = -1;
+/* the children reaped by sigchld() for the front end, see ttystatus() */
+static pid_t reapedpid[XELT_SIZE_REAPED];
+static int reapedstat[XELT_SIZE_REAPED];
+static int nreaped;
+/* images of every terminal by id, the oldest dropped past imagemax */
+static xelt_Image *imgtab;
+static int nimgtab;
+static size_t imgbytes;
+static uint32_t imgnext = 1;
+
+
+static xelt_uchar utfbyte[XELT_SIZE_UTF + 1] = {0x80,    0, 0xC0, 0xE0, 0xF0};
+static xelt_uchar utfmask[XELT_SIZE_UTF + 1] = {0xC0, 0x80, 0xE0, 0xF0, 0xF8};
+static xelt_CharCode utfmin[XELT_SIZE_UTF + 1] = {       0,    0,  0x80,  0x800,  0x10000};
+static xelt_CharCode utfmax[XELT_SIZE_UTF + 1] = {0x10FFFF, 0x7F, 0x7FF, 0xFFFF, 0x10FFFF};
+
+ssize_t
+xwrite(int fd, const char *s, size_t len)
+{
+	size_t aux = len;
+	ssize_t r;
+
+	while (len > 0) {
+		r = write(fd, s, len);
+		if (r < 0)
+			return r;
+		len -= r;
+		s += r;
+	}
+
+	return aux;
+}
+
+void *
+xmalloc(size_t len)
+{
+	void *p = malloc(len);
+
+	if (!p)
+		printAndExit("Out of memory\n");
+
+	return p;
+}
+
+void *
+xrealloc(void *p, size_t len)
+{
+	if ((p = realloc(p, len)) == NULL)
+		printAndExit("Out of memory\n");
+
+	return p;
+}
+
+char *
+xstrdup(char *s)
+{
+	if ((s = strdup(s)) == NULL)
+		printAndExit("Out of memory\n");
+
+	return s;
+}
+
+size_t utf8decode(char *c, xelt_CharCode *u, size_t clen)
+{
+	size_t i, j, len, type;
+	xelt_CharCode udecoded;
+
+	*u = XELT_SIZE_UTF_INVALID;
+	if (!clen)
+		return 0;
+	udecoded = utf8decodebyte(c[0], &len);
+	if (!BETWEEN(len, 1, XELT_SIZE_UTF))
+		return 1;
+	for (i = 1, j = 1; i < clen && j < len; ++i, ++j) {
+		udecoded = (udecoded << 6) | utf8decodebyte(c[i], &type);
+		if (type != 0)
+			return j;
+	}
+	if (j < len)
+		return 0;
+	*u = udecoded;
+	utf8validate(u, len);
+
+	return len;
+}
+
+xelt_CharCode
+utf8decodebyte(char c, size_t *i)
+{
+	for (*i = 0; *i < LEN(utfmask); ++(*i))
+		if (((xelt_uchar)c & utfmask[*i]) == utfbyte[*i])
+			return (xelt_uchar)c & ~utfmask[*i];
+
+	return 0;
+}
+
+size_t
+utf8encode(xelt_CharCode u, char *c)
+{
+	size_t len, i;
+
+	len = utf8validate(&u, 0);
+	if (len > XELT_SIZE_UTF)
+		return 0;
+
+	for (i = len - 1; i != 0; --i) {
+		c[i] = utf8encodebyte(u, 0);
+		u >>= 6;
+	}
+	c[0] = utf8encodebyte(u, len);
+
+	return len;
+}
+
+char
+utf8encodebyte(xelt_CharCode u, size_t i)
+{
+	return utfbyte[i] | (u & ~utfmask[i]);
+}
+
+size_t
+utf8validate(xelt_CharCode *u, size_t i)
+{
+	if (!BETWEEN(*u, utfmin[i], utfmax[i]) || BETWEEN(*u, 0xD800, 0xDFFF))
+		*u = XELT_SIZE_UTF_INVALID;
+	for (i = 1; *u > utfmax[i]; ++i)
+		;
+
+	return i;
+}
+
+void
+selinit(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &sel.tclick1);
+	clock_gettime(CLOCK_MONOTONIC, &sel.tclick2);
+	sel.mode = XELT_SEL_IDLE;
+	sel.snap = 0;
+	sel.ob.x = -1;
+	sel.primary = NULL;
+	sel.clipboard = NULL;
+}
+
+/*
+ * Length of row y without its trailing blanks. It is kept plus one in
+ * the u of the glyph after the last column until tdirty() clears it.
+ */
+int
+tlinelen(int y)
+{
+	xelt_Glyph *mark = &terminal.line[y][terminal.col];
+	int i = terminal.col;
+
+	tlinetouch(terminal.line[y]);
+	if (mark->u)
+		return mark->u - 1;
+
+	if (!(terminal.line[y][i - 1].mode & XELT_ATTR_WRAP)) {
+		while (i > 0 && GLYPHRUNE(terminal.line[y][i - 1]) == ' ')
+			--i;
+	}
+	mark->u = i + 1;
+
+	return i;
+}
+
+void
+selnormalize(void)
+{
+	int i;
+
+	if (sel.type == XELT_SEL_REGULAR && sel.ob.y != sel.oe.y) {
+		sel.nb.x = sel.ob.y < sel.oe.y ? sel.ob.x : sel.oe.x;
+		sel.ne.x = sel.ob.y < sel.oe.y ? sel.oe.x : sel.ob.x;
+	} else {
+		sel.nb.x = MIN(sel.ob.x, sel.oe.x);
+		sel.ne.x = MAX(sel.ob.x, sel.oe.x);
+	}
+	sel.nb.y = MIN(sel.ob.y, sel.oe.y);
+	sel.ne.y = MAX(sel.ob.y, sel.oe.y);
+
+	selsnap(&sel.nb.x, &sel.nb.y, -1);
+	selsnap(&sel.ne.x, &sel.ne.y, +1);
+
+	/* expand selection over line breaks */
+	if (sel.type == XELT_SEL_RECTANGULAR)
+		return;
+	i = tlinelen(sel.nb.y);
+	if (i < sel.nb.x)
+		sel.nb.x = i;
+	if (tlinelen(sel.ne.y) <= sel.ne.x)
+		sel.ne.x = terminal.col - 1;
+}
+
+int
+selected(int x, int y)
+{
+	if (sel.mode == XELT_SEL_EMPTY)
+		return 0;
+
+	if (sel.type == XELT_SEL_RECTANGULAR)
+		return BETWEEN(y, sel.nb.y, sel.ne.y)
+		    && BETWEEN(x, sel.nb.x, sel.ne.x);
+
+	return BETWEEN(y, sel.nb.y, sel.ne.y)
+	    && (y != sel.nb.y || x >= sel.nb.x)
+	    && (y != sel.ne.y || x <= sel.ne.x);
+}
+
+/*
+ * selected() for a whole row: the selected columns of row y are *x1 to
+ * *x2. Returns 0 when none is.
+ */
+int
+selrow(int y, int *x1, int *x2)
+{
+	if (sel.mode == XELT_SEL_EMPTY || !BETWEEN(y, sel.nb.y, sel.ne.y))
+		return 0;
+
+	if (sel.type == XELT_SEL_RECTANGULAR) {
+		*x1 = sel.nb.x;
+		*x2 = sel.ne.x;
+	} else {
+		*x1 = (y == sel.nb.y) ? sel.nb.x : 0;
+		*x2 = (y == sel.ne.y) ? sel.ne.x : terminal.col - 1;
+	}
+	return 1;
+}
+
+/*
+ * selected() for a whole region: whether any of its cells is selected.
+ * Rows strictly inside a regular selection are selected on their full
+ * width, so at most the first and last rows need a look.
+ */
+int
+selintersect(int x1, int y1, int x2, int y2)
+{
+	int y, sx1, sx2;
+
+	if (sel.mode == XELT_SEL_EMPTY)
+		return 0;
+
+	if (sel.type == XELT_SEL_RECTANGULAR)
+		return y1 <= sel.ne.y && y2 >= sel.nb.y
+		    && x1 <= sel.ne.x && x2 >= sel.nb.x;
+
+	for (y = MAX(y1, sel.nb.y); y <= MIN(y2, sel.ne.y); y++) {
+		sx1 = (y == sel.nb.y) ? sel.nb.x : 0;
+		sx2 = (y == sel.ne.y) ? sel.ne.x : terminal.col - 1;
+		if (x1 <= sx2 && x2 >= sx1)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Read worddelimiters once: ASCII in a bitmap, the other characters
+ * sorted and merged into ranges for a binary search.
+ */
+void
+tdeliminit(void)
+{
+	xelt_CharCode u;
+	size_t i, n, len = strlen(worddelimiters);
+	int j, k;
+
+	if (ndelimrange >= 0)
+		return;
+	ndelimrange = 0;
+	for (i = 0; i < len; i += n) {
+		if (!(n = utf8decode(&worddelimiters[i], &u, len - i)))
+			break;
+		if (u < 128) {
+			delimascii[u / 32] |= 1U << (u % 32);
+			continue;
+		}
+		for (j = ndelimrange; j > 0 && delimrange[j-1][0] > u; j--)
+			;
+		memmove(&delimrange[j+1], &delimrange[j],
+				(ndelimrange - j) * sizeof(*delimrange));
+		delimrange[j][0] = delimrange[j][1] = u;
+		ndelimrange++;
+	}
+	for (j = 0, k = 0; j < ndelimrange; j++) {
+		if (k > 0 && delimrange[j][0] <= delimrange[k-1][1] + 1) {
+			delimrange[k-1][1] = MAX(delimrange[k-1][1], delimrange[j][1]);
+			continue;
+		}
+		delimrange[k][0] = delimrange[j][0];
+		delimrange[k][1] = delimrange[j][1];
+		k++;
+	}
+	ndelimrange = k;
+}
+
+int
+isdelim(xelt_CharCode u)
+{
+	int lo = 0, hi = ndelimrange - 1, mid;
+
+	if (u < 128)
+		return delimascii[u / 32] >> (u % 32) & 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (u < delimrange[mid][0])
+			hi = mid - 1;
+		else if (u > delimrange[mid][1])
+			lo = mid + 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+void
+selsnap(int *x, int *y, int direction)
+{
+	int newx, newy, len;
+	int delim, prevdelim;
+	xelt_Glyph *gp, *prevgp;
+	xelt_Line line, next;
+
+	switch (sel.snap) {
+	case XELT_SELSNAP_WORD:
+		/*
+		 * Snap around if the word wraps around at the end or
+		 * beginning of a line. One scan, the length of a row is
+		 * read when the scan enters it.
+		 */
+		len = tlinelen(*y);
+		line = terminal.line[*y];
+		prevgp = &line[*x];
+		prevdelim = ISDELIM(GLYPHRUNE(*prevgp));
+		for (;;) {
+			newx = *x + direction;
+			newy = *y;
+			if (!BETWEEN(newx, 0, terminal.col - 1)) {
+				newy += direction;
+				newx = (newx + terminal.col) % terminal.col;
+				if (!BETWEEN(newy, 0, terminal.row - 1))
+					break;
+
+				len = tlinelen(newy);
+				next = terminal.line[newy];
+				if (!(((direction > 0) ? line : next)
+						[terminal.col - 1].mode & XELT_ATTR_WRAP))
+					break;
+				line = next;
+			}
+
+			if (newx >= len)
+				break;
+
+			gp = &line[newx];
+			delim = ISDELIM(GLYPHRUNE(*gp));
+			if (!(gp->mode & XELT_ATTR_WDUMMY) && (delim != prevdelim
+					|| (delim && GLYPHRUNE(*gp) != GLYPHRUNE(*prevgp))))
+				break;
+
+			*x = newx;
+			*y = newy;
+			prevgp = gp;
+			prevdelim = delim;
+		}
+		break;
+	case XELT_SELSNAP_LINE:
+		/*
+		 * Snap around if the the previous line or the current one
+		 * has set XELT_ATTR_WRAP at its end. Then the whole next or
+		 * previous line will be selected.
+		 */
+		*x = (direction < 0) ? 0 : terminal.col - 1;
+		if (direction < 0) {
+			for (; *y > 0; *y += direction) {
+				tlinetouch(terminal.line[*y-1]);
+				if (!(terminal.line[*y-1][terminal.col-1].mode
+						& XELT_ATTR_WRAP)) {
+					break;
+				}
+			}
+		} else if (direction > 0) {
+			for (; *y < terminal.row-1; *y += direction) {
+				tlinetouch(terminal.line[*y]);
+				if (!(terminal.line[*y][terminal.col-1].mode
+						& XELT_ATTR_WRAP)) {
+					break;
+				}
+			}
+		}
+		break;
+	}
+}
+
+/*
+ * Encode the selected text from r on into buf, whole characters and at
+ * most size bytes. r->done is set at the end of the selection.
+ */
+size_t
+getselread(xelt_SelReader *r, char *buf, size_t size)
+{
+	char *ptr = buf, *end = buf + size;
+	int y, x1, x2, lastx, linelen;
+	xelt_Line line;
+
+	if (sel.ob.x == -1) {
+		r->done = 1;
+		return 0;
+	}
+
+	/* append every set & selected glyph to the selection */
+	for (; (y = sel.nb.y + r->y) <= sel.ne.y; r->y++, r->x = -1) {
+		linelen = tlinelen(y);
+		line = terminal.line[y];
+		if (sel.type == XELT_SEL_RECTANGULAR) {
+			x1 = sel.nb.x;
+			lastx = sel.ne.x;
+		} else {
+			x1 = sel.nb.y == y ? sel.nb.x : 0;
+			lastx = (sel.ne.y == y) ? sel.ne.x : terminal.col-1;
+		}
+		x2 = MIN(lastx, linelen-1);
+		while (x2 >= x1 && GLYPHRUNE(line[x2]) == ' ')
+			--x2;
+
+		if (r->x < 0)
+			r->x = x1;
+		for (; r->x <= x2; r->x++) {
+			if (line[r->x].mode & XELT_ATTR_WDUMMY)
+				continue;
+			if (end - ptr < XELT_SIZE_UTF)
+				return ptr - buf;
+			ptr += utf8encode(GLYPHRUNE(line[r->x]), ptr);
+		}
+
+		/*
+		 * Copy and pasting of line endings is inconsistent
+		 * in the inconsistent terminal and GUI world.
+		 * The best solution seems like to produce '\n' when
+		 * something is copied from st and convert '\n' to
+		 * '\r', when something to be pasted is received by
+		 * st.
+		 * FIXME: Fix the computer world.
+		 */
+		if (linelen == 0 || ((y < sel.ne.y || lastx >= linelen)
+				&& !(x2 >= 0 && line[x2].mode & XELT_ATTR_WRAP))) {
+			if (ptr == end)
+				return ptr - buf;
+			*ptr++ = '\n';
+		}
+	}
+	r->done = 1;
+	return ptr - buf;
+}
+
+char *getsel(void)
+{
+	xelt_SelReader r = { 0, -1, 0 };
+	size_t len = 0, size = 0;
+	char *str = NULL;
+
+	if (sel.ob.x == -1)
+		return NULL;
+
+	/* grown with the text, the worst case is seldom met */
+	while (!r.done) {
+		if (size - len <= BUFSIZ) {
+			size = 2 * size + BUFSIZ;
+			str = xrealloc(str, size);
+		}
+		len += getselread(&r, str + len, size - len - 1);
+	}
+	str[len] = 0;
+	return str;
+}
+
+/*
+ * A copy only takes the selection as primary, sel.lazy, its text is
+ * encoded when asked for. It is encoded here before the selected
+ * glyphs change, the selection is cleared or its terminal swapped out.
+ */
+void
+selencode(void)
+{
+	if (!sel.lazy)
+		return;
+	sel.lazy = 0;
+	free(sel.primary);
+	sel.primary = getsel();
+}
+
+void
+selclear(void)
+{
+	selencode();
+	if (sel.ob.x == -1)
+		return;
+	sel.mode = XELT_SEL_IDLE;
+	sel.ob.x = -1;
+	tsetdirt(sel.nb.y, sel.ne.y);
+}
+
+
+void
+printAndExit(const char *errstr, ...)
+{
+	va_list ap;
+
+	va_start(ap, errstr);
+	vfprintf(stderr, errstr, ap);
+	va_end(ap);
+	exit(1);
+}
+
+void
+execsh(char **cmd)
+{
+	char *me="execsh";
+	xelt_log(me,"started");
+	
+	char **args, *sh, *prog;
+	const struct passwd *pw;
+
+	errno = 0;
+	if ((pw = getpwuid(getuid())) == NULL) {
+		if (errno)
+			printAndExit("getpwuid:%s\n", strerror(errno));
+		else
+			printAndExit("who are you?\n");
+	}
+
+	if ((sh = getenv("SHELL")) == NULL) {
+		sh = (pw->pw_shell[0]) ? pw->pw_shell : shell;
+		xelt_log(me,"getenv(\"SHELL\") is NULL");
+	}
+	
+	snprintf(charbuf256, 256, "%s%s", "shell is: ", sh);
+	xelt_log(me,charbuf256);
+	if (cmd)
+		prog = cmd[0];
+	else if (utmp)
+		prog = utmp;
+	else
+		prog = sh;
+	args = (cmd) ? cmd : (char *[]) {prog, NULL};
+
+	unsetenv("COLUMNS");
+	unsetenv("LINES");
+	unsetenv("TERMCAP");
+	setenv("LOGNAME", pw->pw_name, 1);
+	setenv("USER", pw->pw_name, 1);
+	setenv("SHELL", sh, 1);
+	setenv("HOME", pw->pw_dir, 1);
+	setenv("TERM", termname, 1);
+
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGHUP, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGALRM, SIG_DFL);
+
+	execvp(prog, args);
+	_exit(1);
+}
+
+void
+sigchld(int a)
+{
+	int stat;
+	pid_t p;
+
+	/*
+	 * The front end closes the ttys of its terminals itself, the last
+	 * statuses are kept for it.
+	 */
+	if (termcb.ttyclosed) {
+		while ((p = waitpid(-1, &stat, WNOHANG)) > 0) {
+			reapedpid[nreaped] = p;
+			reapedstat[nreaped] = stat;
+			nreaped = (nreaped + 1) % XELT_SIZE_REAPED;
+		}
+		return;
+	}
+
+	if ((p = waitpid(pid, &stat, WNOHANG)) < 0)
+		printAndExit("Waiting for pid %hd failed: %s\n", pid, strerror(errno));
+
+	if (pid != p)
+		return;
+
+	if (!WIFEXITED(stat) || WEXITSTATUS(stat))
+		printAndExit("child finished with error '%d'\n", stat);
+	exit(0);
+}
+
+
+void
+stty(char **args)
+{
+	char cmd[_POSIX_ARG_MAX], **p, *q, *s;
+	size_t n, siz;
+
+	if ((n = strlen(stty_args)) > sizeof(cmd)-1)
+		printAndExit("incorrect stty parameters\n");
+	memcpy(cmd, stty_args, n);
+	q = cmd + n;
+	siz = sizeof(cmd) - n;
+	for (p = args; p && (s = *p); ++p) {
+		if ((n = strlen(s)) > siz-1)
+			printAndExit("stty parameter length too long\n");
+		*q++ = ' ';
+		memcpy(q, s, n);
+		q += n;
+		siz -= n + 1;
+	}
+	*q = '\0';
+	if (system(cmd) != 0)
+	    perror("Couldn't call stty");
+}
+
+/*
+ * Start the child on a new pty, or use the serial line when line is
+ * given. out is the printer file, "-" for stdout. Returns the tty fd.
+ */
+int
+ttynew(char *line, char *out, char *dir, char **cmd)
+{
+	char *me="ttynew";
+	xelt_log(me,"started");
+	int m, s;
+	struct winsize w = {terminal.row, terminal.col, 0, 0};
+
+	if (out) {
+		terminal.mode |= XELT_TERMINAL_PRINT;
+		ioname = out;
+		iofd = (!strcmp(out, "-")) ?
+			  1 : open(out, O_WRONLY | O_CREAT, 0666);
+		if (iofd < 0) {
+			fprintf(stderr, "Error opening %s:%s\n",
+				out, strerror(errno));
+		}
+	}
+
+	if (line) {
+		if ((cmdfd = open(line, O_RDWR)) < 0)
+			printAndExit("open line failed: %s\n", strerror(errno));
+		dup2(cmdfd, 0);
+		stty(cmd);
+		return cmdfd;
+	}
+
+	/* seems to work fine on linux, openbsd and freebsd */
+	if (openpty(&m, &s, NULL, NULL, &w) < 0)
+		printAndExit("openpty failed: %s\n", strerror(errno));
+	switch (pid = fork()) {
+	case -1:
+		printAndExit("fork failed\n");
+		break;
+	case 0:
+	    xelt_log(me,"fork success");
+		close(iofd);
+		setsid(); /* create a new process group */
+        /* dup() will create the copy of file_desc, then both can be used interchangeably.  */
+		dup2(s, 0); // copy stderr to s 
+		dup2(s, 1); // copy stdout to s 
+		xelt_log(me,"stdout copied to s ");
+		dup2(s, 2);// copy stdin to s 
+		if (ioctl(s, TIOCSCTTY, NULL) < 0)
+			printAndExit("ioctl TIOCSCTTY failed: %s\n", strerror(errno));
+		close(s);
+		close(m);
+		/* the directory of the shell, not of the process */
+		if (dir && chdir(dir) < 0)
+			fprintf(stderr, "chdir %s: %s\n", dir, strerror(errno));
+		execsh(cmd);
+		break;
+	default:
+		close(s);
+		cmdfd = m;
+		signal(SIGCHLD, sigchld);
+		break;
+	}
+
+	return cmdfd;
+}
+
+size_t
+ttyread(void)
+{
+	size_t written;
+	double start = tstatclock();
+	int ret;
+
+	/* append read bytes to unprocessed bytes */
+	ret = read(cmdfd, ttybuf+ttybuflen, LEN(ttybuf)-ttybuflen);
+	if (ret <= 0 && termcb.ttyclosed) {
+		termcb.ttyclosed();
+		return 0;
+	}
+	if (ret < 0)
+		printAndExit("Couldn't read from shell: %s\n", strerror(errno));
+	if (recfile)
+		ttyrecput(ttybuf + ttybuflen, ret);
+
+	/* process every complete utf8 char */
+	ttybuflen += ret;
+	written = twrite(ttybuf, ttybuflen);
+	ttybuflen -= written;
+
+	/* keep any uncomplete utf8 char for the next call */
+	memmove(ttybuf, ttybuf + written, ttybuflen);
+	termstats.readms += tstatclock() - start;
+
+	return ret;
+}
+
+/*
+ * Monotonic clock in ms, for the time counters of termstats.
+ */
+double
+tstatclock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1E3 + ts.tv_nsec / 1E6;
+}
+
+/*
+ * Opt-in profiler of the escape sequences. Counts, touched cells and
+ * time are kept per sequence kind and reported in path ("-" for stderr)
+ * at exit, the most expensive kinds first.
+ */
+void
+tprofile(char *path)
+{
+	profpath = path;
+	proftab = xmalloc(XELT_SIZE_PROF * sizeof(*proftab));
+	memset(proftab, 0, XELT_SIZE_PROF * sizeof(*proftab));
+	strcpy(profother.name, "other");
+	atexit(tprofreport);
+}
+
+void
+tprofstart(xelt_ProfMark *mark)
+{
+	mark->start = tstatclock();
+	mark->cells = termstats.cells + termstats.cleared;
+}
+
+void
+tprofadd(const char *name, xelt_ProfMark *mark)
+{
+	xelt_ProfEntry *e;
+	uint32_t h = 2166136261U;
+	const char *p;
+
+	/* FNV-1a, open addressing */
+	for (p = name; *p; p++)
+		h = (h ^ (xelt_uchar)*p) * 16777619U;
+	for (h &= XELT_SIZE_PROF - 1; proftab[h].count;
+			h = (h + 1) & (XELT_SIZE_PROF - 1)) {
+		if (!strcmp(proftab[h].name, name))
+			break;
+	}
+
+	e = &proftab[h];
+	if (!e->count) {
+		/* garbage can't make the lookups slow */
+		if (proflen >= XELT_SIZE_PROF / 2) {
+			e = &profother;
+		} else {
+			snprintf(e->name, sizeof(e->name), "%s", name);
+			proflen++;
+		}
+	}
+	e->count++;
+	e->cells += termstats.cells + termstats.cleared - mark->cells;
+	e->ms += tstatclock() - mark->start;
+}
+
+void
+tprofcsi(xelt_ProfMark *mark)
+{
+	static const char *names['~' - '@' + 1] = {
+		['@' - '@'] = "ICH", ['A' - '@'] = "CUU", ['B' - '@'] = "CUD",
+		['C' - '@'] = "CUF", ['D' - '@'] = "CUB", ['E' - '@'] = "CNL",
+		['F' - '@'] = "CPL", ['G' - '@'] = "CHA", ['H' - '@'] = "CUP",
+		['I' - '@'] = "CHT", ['J' - '@'] = "ED", ['K' - '@'] = "EL",
+		['L' - '@'] = "IL", ['M' - '@'] = "DL", ['P' - '@'] = "DCH",
+		['S' - '@'] = "SU", ['T' - '@'] = "SD", ['X' - '@'] = "ECH",
+		['Z' - '@'] = "CBT", ['`' - '@'] = "HPA", ['a' - '@'] = "HPR",
+		['b' - '@'] = "REP", ['c' - '@'] = "DA", ['d' - '@'] = "VPA",
+		['e' - '@'] = "VPR", ['f' - '@'] = "HVP", ['g' - '@'] = "TBC",
+		['h' - '@'] = "SM", ['i' - '@'] = "MC", ['l' - '@'] = "RM",
+		['m' - '@'] = "SGR", ['n' - '@'] = "DSR", ['r' - '@'] = "DECSTBM",
+		['s' - '@'] = "SCOSC", ['u' - '@'] = "SCORC",
+	};
+	char name[16];
+	char mode = csiescseq.mode[0];
+	const char *known = BETWEEN(mode, '@', '~') ? names[mode - '@'] : NULL;
+
+	if (csiescseq.priv && (mode == 'h' || mode == 'l') && !csiescseq.mode[1])
+		known = (mode == 'h') ? "DECSET" : "DECRST";
+	else if (csiescseq.priv || csiescseq.mode[1])
+		known = NULL;
+
+	if (known && mode == 'm')
+		snprintf(name, sizeof(name), "SGR %d", csiescseq.narg);
+	else if (known)
+		snprintf(name, sizeof(name), "%s", known);
+	else
+		snprintf(name, sizeof(name), "CSI %s%c%c",
+				csiescseq.priv ? "?" : "",
+				isprint((xelt_uchar)mode) ? mode : '.',
+				isprint((xelt_uchar)csiescseq.mode[1]) ?
+				csiescseq.mode[1] : ' ');
+	tprofadd(name, mark);
+}
+
+void
+tprofesc(xelt_uchar ascii, xelt_ProfMark *mark)
+{
+	char name[16];
+
+	switch (ascii) {
+	case 'D': tprofadd("IND", mark); return;
+	case 'E': tprofadd("NEL", mark); return;
+	case 'H': tprofadd("HTS", mark); return;
+	case 'M': tprofadd("RI", mark); return;
+	case 'c': tprofadd("RIS", mark); return;
+	case '7': tprofadd("DECSC", mark); return;
+	case '8': tprofadd("DECRC", mark); return;
+	}
+	snprintf(name, sizeof(name), "ESC %c", isprint(ascii) ? ascii : '.');
+	tprofadd(name, mark);
+}
+
+void
+tprofstr(xelt_ProfMark *mark)
+{
+	char name[16];
+
+	switch (strescseq.type) {
+	case ']':
+		snprintf(name, sizeof(name), "OSC %d",
+				strescseq.narg ? atoi(strescseq.args[0]) : 0);
+		tprofadd(name, mark);
+		return;
+	case 'P': tprofadd("DCS", mark); return;
+	case '_': tprofadd("APC", mark); return;
+	case '^': tprofadd("PM", mark); return;
+	case 'k': tprofadd("ESC k", mark); return;
+	}
+}
+
+int
+tprofcmp(const void *a, const void *b)
+{
+	const xelt_ProfEntry *x = a, *y = b;
+
+	/* unused slots last, then by time */
+	if (!x->count || !y->count)
+		return !x->count - !y->count;
+	return (x->ms < y->ms) - (x->ms > y->ms);
+}
+
+void
+tprofreport(void)
+{
+	FILE *f;
+	xelt_ProfEntry *e;
+
+	if (!strcmp(profpath, "-"))
+		f = stderr;
+	else if (!(f = fopen(profpath, "w"))) {
+		fprintf(stderr, "Couldn't write %s: %s\n", profpath,
+				strerror(errno));
+		return;
+	}
+
+	qsort(proftab, XELT_SIZE_PROF, sizeof(*proftab), tprofcmp);
+	fprintf(f, "%-12s %10s %12s %10s %10s\n", "sequence", "count",
+			"cells", "ms", "us/seq");
+	for (e = proftab; e < proftab + XELT_SIZE_PROF; e++) {
+		if (!e->count)
+			break;
+		fprintf(f, "%-12s %10lu %12lu %10.2f %10.3f\n", e->name,
+				e->count, e->cells, e->ms, e->ms * 1E3 / e->count);
+	}
+	if (profother.count) {
+		fprintf(f, "%-12s %10lu %12lu %10.2f %10.3f\n", profother.name,
+				profother.count, profother.cells, profother.ms,
+				profother.ms * 1E3 / profother.count);
+	}
+	if (f != stderr)
+		fclose(f);
+}
+
+/*
+ * Captures use the ttyrec format: every read is stored behind a header
+ * of three little endian 32 bit words, seconds, microseconds and length.
+ */
+void
+ttyrecord(char *path)
+{
+	if (!(recfile = fopen(path, "w")))
+		printAndExit("Couldn't open %s: %s\n", path, strerror(errno));
+}
+
+void
+ttyrecput(const char *buf, size_t len)
+{
+	struct timespec ts;
+	uint32_t word[3];
+	xelt_uchar hdr[12];
+	int i;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	word[0] = ts.tv_sec;
+	word[1] = ts.tv_nsec / 1000;
+	word[2] = len;
+	for (i = 0; i < LEN(hdr); i++)
+		hdr[i] = word[i / 4] >> (i % 4 * 8);
+
+	/* flushed every time, the capture has to survive a hang or crash */
+	if (fwrite(hdr, 1, sizeof(hdr), recfile) != sizeof(hdr)
+			|| fwrite(buf, 1, len, recfile) != len
+			|| fflush(recfile)) {
+		fprintf(stderr, "Couldn't write capture, stopped: %s\n",
+				strerror(errno));
+		fclose(recfile);
+		recfile = NULL;
+	}
+}
+
+uint32_t
+ttyrecu32(const xelt_uchar *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*
+ * Feed a capture to the terminal, no shell involved. With realtime the
+ * recorded delays are kept, else it goes as fast as the parser can.
+ * frame, when not NULL, is called after every record. Returns the number
+ * of bytes replayed, -1 when the file can't be opened.
+ */
+long
+treplay(char *path, int realtime, void (*frame)(void))
+{
+	FILE *f;
+	xelt_uchar hdr[12];
+	char *buf = NULL;
+	size_t len, size = 0, keep = 0, written;
+	struct timespec start, now, delay;
+	double first = -1, at, late;
+	long total = 0;
+
+	if (!(f = fopen(path, "r")))
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr)) {
+		len = ttyrecu32(hdr + 8);
+		if (keep + len > size)
+			buf = xrealloc(buf, size = keep + len);
+		if (fread(buf + keep, 1, len, f) != len)
+			break;
+
+		if (realtime) {
+			at = ttyrecu32(hdr) + ttyrecu32(hdr + 4) / 1E6;
+			if (first < 0)
+				first = at;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			late = (now.tv_sec - start.tv_sec)
+				+ (now.tv_nsec - start.tv_nsec) / 1E9;
+			if (at - first > late) {
+				delay.tv_sec = at - first - late;
+				delay.tv_nsec = (at - first - late - delay.tv_sec) * 1E9;
+				nanosleep(&delay, NULL);
+			}
+		}
+
+		/* an incomplete utf8 char waits for the next record */
+		keep += len;
+		written = twrite(buf, keep);
+		keep -= written;
+		memmove(buf, buf + written, keep);
+		total += len;
+
+		if (frame)
+			frame();
+	}
+	free(buf);
+	fclose(f);
+
+	return total;
+}
+
+/*
+ * Feed tty output to the terminal. Returns the number of bytes used,
+ * an incomplete utf8 char at the end is left to the caller.
+ */
+size_t
+twrite(char *buf, size_t len)
+{
+	size_t n = 0, charsize; /* size of utf8 char in bytes */
+	xelt_CharCode unicodep;
+	double start = tstatclock();
+
+	while ((charsize = utf8decode(buf + n, &unicodep, len - n))) {
+		tputc(unicodep);
+		n += charsize;
+	}
+	termstats.bytes += n;
+	termstats.parsems += tstatclock() - start;
+
+	return n;
+}
+
+void ttywrite1(const char *argS, size_t argN)
+{
+	char *me="ttywrite1";
+	xelt_log(me,"started");
+	snprintf(charbuf256, 256, "%s%.*s", "sending argS: ", (int)argN, argS);
+	xelt_log(me,charbuf256);
+	
+	fd_set wfd, rfd;
+	ssize_t r;
+	size_t lim = 256;
+
+	/* answers of a replayed session have nowhere to go */
+	if (cmdfd < 0)
+		return;
+
+	/*
+	 * Remember that we are using a pty, which might be a modem line.
+	 * Writing too much will clog the line. That'argS why we are doing this
+	 * dance.
+	 * FIXME: Migrate the world to Plan 9.
+	 */
+	while (argN > 0) {
+		FD_ZERO(&wfd);
+		FD_ZERO(&rfd);
+		FD_SET(cmdfd, &wfd);
+		FD_SET(cmdfd, &rfd);
+
+		/* Check if we can write. */
+		if (pselect(cmdfd+1, &rfd, &wfd, NULL, NULL, NULL) < 0) {
+			printAndExit("select failed: %argS\argN", strerror(errno));
+		}
+		if (FD_ISSET(cmdfd, &wfd)) {
+			/*
+			 * Only write the bytes written by ttywrite1() or the
+			 * default of 256. This seems to be a reasonable value
+			 * for a serial line. Bigger values might clog the I/O.
+			 */
+			if ((r = write(cmdfd, argS, (argN < lim)? argN : lim)) < 0)
+				printAndExit("write error on tty: %argS\argN", strerror(errno));
+			if (r < argN) {
+				/*
+				 * We weren't able to write out everything.
+				 * This means the buffer is getting full
+				 * again. Empty it.
+				 */
+				if (argN < lim)
+					lim = ttyread();
+				argN -= r;
+				argS += r;
+			} else {
+				/* All bytes have been written. */
+				break;
+			}
+		}
+		if (FD_ISSET(cmdfd, &rfd))
+			lim = ttyread();
+	}
+	return;
+}
+
+
+
+void ttyresize(int tw, int th)
+{
+	struct winsize w;
+
+	terminal.cw = MAX(tw / MAX(terminal.col, 1), 1);
+	terminal.ch = MAX(th / MAX(terminal.row, 1), 1);
+	if (cmdfd < 0)
+		return;
+	w.ws_row = terminal.row;
+	w.ws_col = terminal.col;
+	w.ws_xpixel = tw;
+	w.ws_ypixel = th;
+	if (ioctl(cmdfd, TIOCSWINSZ, &w) < 0)
+		fprintf(stderr, "Couldn't set window size: %s\n", strerror(errno));
+}
+
+void
+ttyhangup(void)
+{
+	/* Send SIGHUP to shell */
+	if (pid)
+		kill(pid, SIGHUP);
+}
+
+/*
+ * Answer an OSC 52 asking for the selections sel with len bytes of
+ * data, base64 encoded.
+ */
+void
+ttyosc52(const char *sel, const char *data, size_t len)
+{
+	static const char b64[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const xelt_uchar *p = (const xelt_uchar *)data;
+	char buf[1024], *q;
+	uint32_t v;
+	size_t i;
+
+	ttywrite1("\033]52;", 5);
+	ttywrite1(sel, strlen(sel));
+	ttywrite1(";", 1);
+	for (i = 0, q = buf; i < len; i += 3) {
+		v = p[i] << 16 | (i + 1 < len ? p[i+1] << 8 : 0)
+			| (i + 2 < len ? p[i+2] : 0);
+		*q++ = b64[v >> 18];
+		*q++ = b64[v >> 12 & 63];
+		*q++ = i + 1 < len ? b64[v >> 6 & 63] : '=';
+		*q++ = i + 2 < len ? b64[v & 63] : '=';
+		if (q == buf + sizeof(buf)) {
+			ttywrite1(buf, q - buf);
+			q = buf;
+		}
+	}
+	ttywrite1(buf, q - buf);
+	ttywrite1("\033\\", 2);
+}
+
+/* Process on the tty, 0 while replaying or headless */
+pid_t
+ttypid(void)
+{
+	return pid;
+}
+
+/*
+ * Wait status of the shell of the terminal once its tty is closed, 0
+ * when it is unknown. The tty may close before the shell is reaped.
+ */
+int
+ttystatus(void)
+{
+	sigset_t set, old;
+	int i, stat = 0;
+
+	if (pid <= 0)
+		return 0;
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &set, &old);
+	if (waitpid(pid, &stat, 0) != pid) {
+		stat = 0;
+		for (i = 0; i < XELT_SIZE_REAPED; i++) {
+			if (reapedpid[i] == pid)
+				stat = reapedstat[i];
+		}
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return stat;
+}
+
+void
+ttysendbreak(void)
+{
+	if (cmdfd >= 0 && tcsendbreak(cmdfd, 0))
+		perror("Error sending break");
+}
+
+void
+tsetdirt(int top, int bot)
+{
+	int i;
+
+	LIMIT(top, 0, terminal.row-1);
+	LIMIT(bot, 0, terminal.row-1);
+
+	for (i = top; i <= bot; i++)
+		tdirty(i);
+}
+
+/* Row y has changed: drawn again and its length counted again */
+void
+tdirty(int y)
+{
+	terminal.dirty[y] = 1;
+	terminal.line[y][terminal.col].u = 0;
+}
+
+
+void
+tfulldirt(void)
+{
+	tsetdirt(0, terminal.row-1);
+}
+
+/*
+ * The whole screen changed its look, let the front end draw it now.
+ */
+void
+tredraw(void)
+{
+	tfulldirt();
+	if (termcb.draw)
+		termcb.draw();
+}
+
+void
+tcursor(int mode)
+{
+	xelt_TCursor *c = terminal.saved;
+	int alt = IS_SET(XELT_TERMINAL_ALTSCREEN);
+
+	if (mode == XELT_CURSOR_SAVE) {
+		c[alt] = terminal.cursor;
+	} else if (mode == XELT_CURSOR_LOAD) {
+		terminal.cursor = c[alt];
+		tmoveto(c[alt].x, c[alt].y);
+	}
+}
+
+void
+treset(void)
+{
+	xelt_uint i;
+
+	terminal.cursor = (xelt_TCursor){{
+		.mode = XELT_ATTR_NULL,
+		.fg = defaultfg,
+		.bg = defaultbg
+	}, .x = 0, .y = 0, .state = XELT_CURSOR_DEFAULT};
+
+	memset(terminal.tabs, 0, terminal.col * sizeof(*terminal.tabs));
+	for (i = tabspaces; i < terminal.col; i += tabspaces)
+		terminal.tabs[i] = 1;
+	terminal.top = 0;
+	terminal.bot = terminal.row - 1;
+	terminal.left = 0;
+	terminal.right = terminal.col - 1;
+	terminal.mode = XELT_TERMINAL_WRAP;
+	memset(terminal.trantbl, XELT_CHARSET_USA, sizeof(terminal.trantbl));
+	terminal.charset = 0;
+
+	for (i = 0; i < 2; i++) {
+		tmoveto(0, 0);
+		tcursor(XELT_CURSOR_SAVE);
+		tclearregion(0, 0, terminal.col-1, terminal.row-1);
+		tswapscreen();
+	}
+}
+
+void
+tnew(int col, int row, const xelt_TermCallbacks *cb)
+{
+	if (cb)
+		termcb = *cb;
+	tdeliminit();
+	/* the cell size is a guess until ttyresize() */
+	terminal = (xelt_Terminal){ .cursor = { .attr = { .fg = defaultfg, .bg = defaultbg } },
+		.cw = 10, .ch = 20 };
+	csireset();
+	/* buf and data may belong to a saved terminal */
+	strescseq = (xelt_STREscape){ 0 };
+	sel.mode = XELT_SEL_IDLE;
+	sel.ob.x = -1;
+	cmdfd = -1;
+	pid = 0;
+	recfile = NULL;
+	ttybuflen = 0;
+	tresize(col, row);
+	terminal.numlock = 1;
+
+	treset();
+}
+
+/*
+ * Close the tty of the terminal and free its screens. The globals are
+ * left to the next tnew() or tload().
+ */
+void
+tfree(void)
+{
+	int i;
+
+	selencode();
+	if (cmdfd >= 0)
+		close(cmdfd);
+	if (recfile)
+		fclose(recfile);
+	for (i = 0; i < terminal.row; i++) {
+		free(terminal.line[i]);
+		free(terminal.alt[i]);
+	}
+	free(terminal.line);
+	free(terminal.alt);
+	free(terminal.dirty);
+	free(terminal.tabs);
+	tlinkfree();
+	strreset();
+	free(strescseq.buf);
+	strescseq = (xelt_STREscape){ 0 };
+	terminal = (xelt_Terminal){ 0 };
+	cmdfd = -1;
+	pid = 0;
+	recfile = NULL;
+}
+
+void
+tsave(xelt_TermState *st)
+{
+	selencode();
+	st->terminal = terminal;
+	st->sel = sel;
+	st->csiescseq = csiescseq;
+	st->strescseq = strescseq;
+	st->cmdfd = cmdfd;
+	st->pid = pid;
+	st->recfile = recfile;
+	st->ttypendlen = MIN(ttybuflen, (int)sizeof(st->ttypend));
+	memcpy(st->ttypend, ttybuf, st->ttypendlen);
+}
+
+void
+tload(const xelt_TermState *st)
+{
+	char *primary = sel.primary, *clipboard = sel.clipboard;
+	int lazy = sel.lazy;
+
+	terminal = st->terminal;
+	sel = st->sel;
+	sel.primary = primary;
+	sel.clipboard = clipboard;
+	sel.lazy = lazy;
+	csiescseq = st->csiescseq;
+	strescseq = st->strescseq;
+	cmdfd = st->cmdfd;
+	pid = st->pid;
+	recfile = st->recfile;
+	ttybuflen = st->ttypendlen;
+	memcpy(ttybuf, st->ttypend, ttybuflen);
+}
+
+void
+tswapscreen(void)
+{
+	xelt_Line *tmp = terminal.line;
+
+	selencode();
+	terminal.line = terminal.alt;
+	terminal.alt = tmp;
+	terminal.mode ^= XELT_TERMINAL_ALTSCREEN;
+	tfulldirt();
+}
+
+void
+tscrolldown(int orig, int n)
+{
+	int i;
+	xelt_Line temp;
+
+	LIMIT(n, 0, terminal.bot-orig+1);
+	termstats.scrolled += n;
+
+	if (terminal.left > 0 || terminal.right < terminal.col-1) {
+		tscrollcols(orig, -n);
+		return;
+	}
+
+	tsetdirt(orig, terminal.bot-n);
+	tclearregion(0, terminal.bot-n+1, terminal.col-1, terminal.bot);
+
+	for (i = terminal.bot; i >= orig+n; i--) {
+		temp = terminal.line[i];
+		terminal.line[i] = terminal.line[i-n];
+		terminal.line[i-n] = temp;
+	}
+
+	selscroll(orig, n);
+}
+
+void
+tscrollup(int orig, int n)
+{
+	int i;
+	xelt_Line temp;
+
+	LIMIT(n, 0, terminal.bot-orig+1);
+	termstats.scrolled += n;
+
+	if (terminal.left > 0 || terminal.right < terminal.col-1) {
+		tscrollcols(orig, n);
+		return;
+	}
+
+	tclearregion(0, orig, terminal.col-1, orig+n-1);
+	tsetdirt(orig+n, terminal.bot);
+
+	for (i = orig; i <= terminal.bot-n; i++) {
+		temp = terminal.line[i];
+		terminal.line[i] = terminal.line[i+n];
+		terminal.line[i+n] = temp;
+	}
+
+	selscroll(orig, -n);
+}
+
+/*
+ * Scroll between the left and right margins, up when n > 0: rows can't
+ * be swapped, the segment between the margins is moved with one
+ * memmove per row and the columns outside stay untouched, but for the
+ * double width characters cut by the margins.
+ */
+void
+tscrollcols(int orig, int n)
+{
+	int i, src, l = terminal.left, r = terminal.right;
+
+	if (selintersect(l, orig, r, terminal.bot))
+		selclear();
+
+	for (i = orig; i <= terminal.bot - abs(n); i++) {
+		if (n > 0) {
+			src = i + n;
+		} else {
+			/* down, from the bottom */
+			src = terminal.bot - (i - orig) + n;
+		}
+		tlinetouch(terminal.line[src]);
+		tlinetouch(terminal.line[src - n]);
+		memmove(&terminal.line[src - n][l], &terminal.line[src][l],
+				(r - l + 1) * sizeof(xelt_Glyph));
+	}
+	tsetdirt(orig, terminal.bot);
+
+	if (n > 0)
+		tclearregion(l, terminal.bot-n+1, r, terminal.bot);
+	else if (n < 0)
+		tclearregion(l, orig, r, orig-n-1);
+
+	for (i = orig; i <= terminal.bot; i++) {
+		tlinetouch(terminal.line[i]);
+		tmendwide(terminal.line[i], l, r);
+	}
+}
+
+void
+selscroll(int orig, int n)
+{
+	if (sel.ob.x == -1)
+		return;
+
+	if (BETWEEN(sel.ob.y, orig, terminal.bot) || BETWEEN(sel.oe.y, orig, terminal.bot)) {
+		/* the text moves with it, unless split or clipped */
+		if (!BETWEEN(sel.ob.y, orig, terminal.bot)
+				|| !BETWEEN(sel.oe.y, orig, terminal.bot)
+				|| !BETWEEN(sel.ob.y + n, orig, terminal.bot)
+				|| !BETWEEN(sel.oe.y + n, orig, terminal.bot))
+			selencode();
+		if ((sel.ob.y += n) > terminal.bot || (sel.oe.y += n) < terminal.top) {
+			selclear();
+			return;
+		}
+		if (sel.type == XELT_SEL_RECTANGULAR) {
+			if (sel.ob.y < terminal.top)
+				sel.ob.y = terminal.top;
+			if (sel.oe.y > terminal.bot)
+				sel.oe.y = terminal.bot;
+		} else {
+			if (sel.ob.y < terminal.top) {
+				sel.ob.y = terminal.top;
+				sel.ob.x = 0;
+			}
+			if (sel.oe.y > terminal.bot) {
+				sel.oe.y = terminal.bot;
+				sel.oe.x = terminal.col;
+			}
+		}
+		selnormalize();
+	}
+}
+
+void
+tnewline(int first_col)
+{
+	int y = terminal.cursor.y;
+
+	if (y == terminal.bot) {
+		tscrollup(terminal.top, 1);
+	} else {
+		y++;
+	}
+	tmoveto(first_col ? 0 : terminal.cursor.x, y);
+}
+
+/*
+ * Read one byte of a CSI sequence. Parameters are converted as they
+ * come and also given to the SGR delta, so once the final byte is known
+ * neither the args nor the attributes need another pass.
+ */
+void
+csiput(xelt_uchar c)
+{
+	/* parameters are over, only the byte after the mode is kept */
+	if (csiescseq.mode[0]) {
+		if (!csiescseq.mode[1])
+			csiescseq.mode[1] = c;
+		return;
+	}
+
+	if (BETWEEN(c, '0', '9')) {
+		csiescseq.cur = MIN(csiescseq.cur * 10 + (c - '0'), 65535);
+	} else if (c == ';' || c == ':') {
+		csiarg();
+		csiescseq.colon = (c == ':');
+		csiescseq.sub |= csiescseq.colon;
+	} else if (c == '?' && csiescseq.len == 1) {
+		csiescseq.priv = 1;
+	} else {
+		csiarg();
+		csiescseq.mode[0] = c;
+	}
+}
+
+void
+csiarg(void)
+{
+	if (csiescseq.narg < XELT_ESC_ARG_SIZ)
+		csiescseq.arg[csiescseq.narg++] = csiescseq.cur;
+	tsgrparam(csiescseq.cur, csiescseq.colon);
+	csiescseq.cur = 0;
+}
+
+/*
+ * End of the sequence. Without a final byte, the buffer being full,
+ * the last parameter is still pending.
+ */
+void
+csiparse(void)
+{
+	if (!csiescseq.mode[0])
+		csiarg();
+	csiescseq.buf[csiescseq.len] = '\0';
+}
+
+/* for absolute user moves, when decom is set */
+void
+tmoveato(int x, int y)
+{
+	tmoveto(x, y + ((terminal.cursor.state & XELT_CURSOR_ORIGIN) ? terminal.top: 0));
+}
+
+void
+tmoveto(int x, int y)
+{
+	int miny, maxy;
+
+	if (terminal.cursor.state & XELT_CURSOR_ORIGIN) {
+		miny = terminal.top;
+		maxy = terminal.bot;
+	} else {
+		miny = 0;
+		maxy = terminal.row - 1;
+	}
+	terminal.cursor.state &= ~XELT_CURSOR_WRAPNEXT;
+	terminal.cursor.x = LIMIT(x, 0, terminal.col-1);
+	terminal.cursor.y = LIMIT(y, miny, maxy);
+}
+
+void
+tsetchar(xelt_CharCode u, xelt_Glyph *attr, int x, int y)
+{
+	static char *vt100_0[62] = { /* 0x41 - 0x7e */
+		"↑", "↓", "→", "←", "█", "▚", "☃", /* A - G */
+		0, 0, 0, 0, 0, 0, 0, 0, /* H - O */
+		0, 0, 0, 0, 0, 0, 0, 0, /* P - W */
+		0, 0, 0, 0, 0, 0, 0, " ", /* X - _ */
+		"◆", "▒", "␉", "␌", "␍", "␊", "°", "±", /* ` - g */
+		"␤", "␋", "┘", "┐", "┌", "└", "┼", "⎺", /* h - o */
+		"⎻", "─", "⎼", "⎽", "├", "┤", "┴", "┬", /* p - w */
+		"│", "≤", "≥", "π", "≠", "£", "·", /* x - ~ */
+	};
+
+	/*
+	 * The table is proudly stolen from rxvt.
+	 */
+	if (terminal.trantbl[terminal.charset] == XELT_CHARSET_GRAPHIC0 &&
+	   BETWEEN(u, 0x41, 0x7e) && vt100_0[u - 0x41])
+		utf8decode(vt100_0[u - 0x41], &u, XELT_SIZE_UTF);
+
+	tlinetouch(terminal.line[y]);
+	if (terminal.line[y][x].mode & XELT_ATTR_WIDE) {
+		if (x+1 < terminal.col) {
+			terminal.line[y][x+1].u = ' ';
+			terminal.line[y][x+1].mode &= ~XELT_ATTR_WDUMMY;
+		}
+	} else if (terminal.line[y][x].mode & XELT_ATTR_WDUMMY && x > 0) {
+		terminal.line[y][x-1].u = ' ';
+		terminal.line[y][x-1].mode &= ~XELT_ATTR_WIDE;
+	}
+
+	tdirty(y);
+	terminal.line[y][x] = *attr;
+	terminal.line[y][x].u = u;
+	termstats.cells++;
+}
+
+/*
+ * Store g in line[x1..x2]. The first cell is set, the part filled so far
+ * is then copied onto the rest, doubling every time, which memcpy turns
+ * into wide stores.
+ */
+void
+tfillrow(xelt_Line line, int x1, int x2, xelt_Glyph g)
+{
+	int n = x2 - x1 + 1, done, len;
+
+	if (n <= 0)
+		return;
+	line[x1] = g;
+	for (done = 1; done < n; done += len) {
+		len = MIN(done, n - done);
+		memcpy(&line[x1 + done], &line[x1], len * sizeof(xelt_Glyph));
+	}
+}
+
+/*
+ * A row cleared on its full width is only marked: the glyph after its
+ * last column gets XELT_ATTR_LAZY and the colours of the blank, its u
+ * is the length cached by tlinelen(). It moves with the row when
+ * scrolling and the row is filled here before it is read or written
+ * again.
+ */
+void
+tlinetouch(xelt_Line line)
+{
+	xelt_Glyph *mark = &line[terminal.col], blank;
+
+	if (!(mark->mode & XELT_ATTR_LAZY))
+		return;
+	mark->mode = 0;
+	blank = *mark;
+	blank.u = ' ';
+	tfillrow(line, 0, terminal.col - 1, blank);
+}
+
+void
+tclearregion(int x1, int y1, int x2, int y2)
+{
+	int y, temp;
+	xelt_Glyph blank = { ' ', 0, 0, 0, 0 };
+	xelt_Line line;
+
+	if (x1 > x2)
+		temp = x1, x1 = x2, x2 = temp;
+	if (y1 > y2)
+		temp = y1, y1 = y2, y2 = temp;
+
+	LIMIT(x1, 0, terminal.col-1);
+	LIMIT(x2, 0, terminal.col-1);
+	LIMIT(y1, 0, terminal.row-1);
+	LIMIT(y2, 0, terminal.row-1);
+	termstats.cleared += (x2 - x1 + 1) * (y2 - y1 + 1);
+
+	if (selintersect(x1, y1, x2, y2))
+		selclear();
+
+	blank.fg = terminal.cursor.attr.fg;
+	blank.bg = terminal.cursor.attr.bg;
+	for (y = y1; y <= y2; y++) {
+		line = terminal.line[y];
+		if (x1 == 0 && x2 == terminal.col - 1) {
+			line[terminal.col] = blank;
+			line[terminal.col].mode = XELT_ATTR_LAZY;
+		} else {
+			tlinetouch(line);
+			tfillrow(line, x1, x2, blank);
+		}
+		tdirty(y);
+	}
+}
+
+/*
+ * Before line[x1..x2] is overwritten: the halves of double width
+ * characters cut by the edges become blanks.
+ */
+void
+tfixwide(xelt_Line line, int x1, int x2)
+{
+	if (line[x1].mode & XELT_ATTR_WDUMMY && x1 > 0) {
+		line[x1-1].u = ' ';
+		line[x1-1].mode &= ~XELT_ATTR_WIDE;
+	}
+	if (line[x2].mode & XELT_ATTR_WIDE && x2+1 < terminal.col) {
+		line[x2+1].u = ' ';
+		line[x2+1].mode &= ~XELT_ATTR_WDUMMY;
+	}
+}
+
+/*
+ * After cells are copied into line[x1..x2]: the halves of double width
+ * characters cut by the edges, on either side, become blanks.
+ */
+void
+tmendwide(xelt_Line line, int x1, int x2)
+{
+	if (line[x1].mode & XELT_ATTR_WDUMMY) {
+		line[x1].u = ' ';
+		line[x1].mode &= ~XELT_ATTR_WDUMMY;
+	}
+	if (line[x2].mode & XELT_ATTR_WIDE) {
+		line[x2].u = ' ';
+		line[x2].mode &= ~XELT_ATTR_WIDE;
+	}
+	if (x1 > 0 && line[x1-1].mode & XELT_ATTR_WIDE) {
+		line[x1-1].u = ' ';
+		line[x1-1].mode &= ~XELT_ATTR_WIDE;
+	}
+	if (x2+1 < terminal.col && line[x2+1].mode & XELT_ATTR_WDUMMY) {
+		line[x2+1].u = ' ';
+		line[x2+1].mode &= ~XELT_ATTR_WDUMMY;
+	}
+}
+
+/*
+ * Rectangle of a DEC rectangular area operation from its top, left,
+ * bottom and right parameters, relative to the scroll region in origin
+ * mode. 0 when it is empty.
+ */
+int
+trect(int *arg, int *x1, int *y1, int *x2, int *y2)
+{
+	int top = 0, bot = terminal.row - 1;
+
+	if (terminal.cursor.state & XELT_CURSOR_ORIGIN)
+		top = terminal.top, bot = terminal.bot;
+
+	*y1 = top + MAX(arg[0], 1) - 1;
+	*x1 = MAX(arg[1], 1) - 1;
+	*y2 = arg[2] ? MIN(top + arg[2] - 1, bot) : bot;
+	*x2 = arg[3] ? MIN(arg[3] - 1, terminal.col - 1) : terminal.col - 1;
+
+	return *y1 <= *y2 && *x1 <= *x2;
+}
+
+/*
+ * DECCRA: copy the rectangle to the one at dx, dy, clipped to the
+ * screen. One memmove per row, bottom up when moving down so the
+ * source rows aren't overwritten before they are copied.
+ */
+void
+tcopyrect(int x1, int y1, int x2, int y2, int dx, int dy)
+{
+	int w = MIN(x2 - x1 + 1, terminal.col - dx);
+	int h = MIN(y2 - y1 + 1, terminal.row - dy);
+	int i, n, src, dst;
+	if (w <= 0 || h <= 0 || (dx == x1 && dy == y1))
+		return;
+	if (selintersect(dx, dy, dx + w - 1, dy + h - 1))
+		selclear();
+
+	for (n = 0; n < h; n++) {
+		i = (dy > y1) ? h - 1 - n : n;
+		src = y1 + i;
+		dst = dy + i;
+		tlinetouch(terminal.line[src]);
+		tlinetouch(terminal.line[dst]);
+		/* mended once copied, the source may be on the same row */
+		memmove(&terminal.line[dst][dx], &terminal.line[src][x1],
+				w * sizeof(xelt_Glyph));
+		tmendwide(terminal.line[dst], dx, dx + w - 1);
+		tdirty(dst);
+	}
+	termstats.cells += w * h;
+}
+
+/*
+ * DECFRA: fill the rectangle with u in the current attributes.
+ */
+void
+tfillrect(int x1, int y1, int x2, int y2, xelt_CharCode u)
+{
+	xelt_Glyph g = terminal.cursor.attr;
+	int y;
+
+	g.u = u;
+	if (selintersect(x1, y1, x2, y2))
+		selclear();
+
+	for (y = y1; y <= y2; y++) {
+		tlinetouch(terminal.line[y]);
+		tfixwide(terminal.line[y], x1, x2);
+		tfillrow(terminal.line[y], x1, x2, g);
+		tdirty(y);
+	}
+	termstats.cells += (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
+/*
+ * DECSERA: blank the characters not protected with DECSCA, their
+ * attributes are kept.
+ */
+void
+tsclearregion(int x1, int y1, int x2, int y2)
+{
+	xelt_Glyph *gp, *end;
+	int y;
+
+	if (selintersect(x1, y1, x2, y2))
+		selclear();
+
+	for (y = y1; y <= y2; y++) {
+		tlinetouch(terminal.line[y]);
+		tfixwide(terminal.line[y], x1, x2);
+		end = &terminal.line[y][x2];
+		for (gp = &terminal.line[y][x1]; gp <= end; gp++) {
+			if (gp->mode & XELT_ATTR_PROTECTED)
+				continue;
+			/* the fg of an image cell is its tile, not a colour */
+			if (gp->mode & XELT_ATTR_IMAGE)
+				gp->fg = terminal.cursor.attr.fg;
+			gp->u = ' ';
+			gp->mode &= ~(XELT_ATTR_WIDE | XELT_ATTR_WDUMMY
+					| XELT_ATTR_IMAGE);
+		}
+		tdirty(y);
+	}
+	termstats.cleared += (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
+void
+tdeletechar(int n)
+{
+	int dst, src, size;
+	xelt_Glyph *line;
+
+	/* the characters right of the cursor up to the right margin move */
+	if (!BETWEEN(terminal.cursor.x, terminal.left, terminal.right))
+		return;
+	LIMIT(n, 0, terminal.right + 1 - terminal.cursor.x);
+
+	dst = terminal.cursor.x;
+	src = terminal.cursor.x + n;
+	size = terminal.right + 1 - src;
+	line = terminal.line[terminal.cursor.y];
+	tlinetouch(line);
+	if (selintersect(dst, terminal.cursor.y, terminal.right, terminal.cursor.y))
+		selclear();
+
+	memmove(&line[dst], &line[src], size * sizeof(xelt_Glyph));
+	tclearregion(terminal.right+1-n, terminal.cursor.y, terminal.right, terminal.cursor.y);
+}
+
+void
+tinsertblank(int n)
+{
+	int dst, src, size;
+	xelt_Glyph *line;
+
+	if (!BETWEEN(terminal.cursor.x, terminal.left, terminal.right))
+		return;
+	LIMIT(n, 0, terminal.right + 1 - terminal.cursor.x);
+
+	dst = terminal.cursor.x + n;
+	src = terminal.cursor.x;
+	size = terminal.right + 1 - dst;
+	line = terminal.line[terminal.cursor.y];
+	tlinetouch(line);
+	if (selintersect(src, terminal.cursor.y, terminal.right, terminal.cursor.y))
+		selclear();
+
+	memmove(&line[dst], &line[src], size * sizeof(xelt_Glyph));
+	tclearregion(src, terminal.cursor.y, dst - 1, terminal.cursor.y);
+}
+
+void
+tinsertblankline(int n)
+{
+	if (BETWEEN(terminal.cursor.y, terminal.top, terminal.bot)
+			&& BETWEEN(terminal.cursor.x, terminal.left, terminal.right))
+		tscrolldown(terminal.cursor.y, n);
+}
+
+void
+tdeleteline(int n)
+{
+	if (BETWEEN(terminal.cursor.y, terminal.top, terminal.bot)
+			&& BETWEEN(terminal.cursor.x, terminal.left, terminal.right))
+		tscrollup(terminal.cursor.y, n);
+}
+
+
+
+void
+tsgrmode(int set, xelt_ushort bits)
+{
+	if (set) {
+		csiescseq.sgr.set |= bits;
+		csiescseq.sgr.clear &= ~bits;
+	} else {
+		csiescseq.sgr.clear |= bits;
+		csiescseq.sgr.set &= ~bits;
+	}
+}
+
+/*
+ * Add one SGR parameter to the delta. colon is set for a ':'
+ * sub-parameter, as in 4:3 or 38:2::r:g:b.
+ */
+void
+tsgrparam(int p, int colon)
+{
+	xelt_SGRDelta *d = &csiescseq.sgr;
+
+	if (d->ext) {
+		if (!d->nsub)
+			d->extcolon = colon;
+		if (colon == d->extcolon) {
+			if (d->nsub < LEN(d->sub))
+				d->sub[d->nsub++] = p;
+			/* the ';' forms have a known length */
+			if (!d->extcolon && (d->sub[0] != 5 || d->nsub == 2)
+					&& (d->sub[0] != 2 || d->nsub == 4))
+				tsgrext();
+			return;
+		}
+		/* end of a ':' colour, p is a parameter of its own */
+		tsgrext();
+	}
+
+	if (colon) {
+		/* 4:0 is no underline, 4:1 to 4:5 are underline styles */
+		if (d->last == 4)
+			tsgrmode(p != 0, XELT_ATTR_UNDERLINE);
+		return;
+	}
+	d->last = p;
+
+	switch (p) {
+	case 0:
+		d->clear = XELT_ATTR_SGR;
+		d->set = 0;
+		d->fg = defaultfg;
+		d->bg = defaultbg;
+		d->setfg = d->setbg = 1;
+		break;
+	case 1:  tsgrmode(1, XELT_ATTR_BOLD); break;
+	case 2:  tsgrmode(1, XELT_ATTR_FAINT); break;
+	case 3:  tsgrmode(1, XELT_ATTR_ITALIC); break;
+	case 4:  tsgrmode(1, XELT_ATTR_UNDERLINE); break;
+	case 5:  /* slow blink */
+	case 6:  tsgrmode(1, XELT_ATTR_BLINK); break;
+	case 7:  tsgrmode(1, XELT_ATTR_REVERSE); break;
+	case 8:  tsgrmode(1, XELT_ATTR_INVISIBLE); break;
+	case 9:  tsgrmode(1, XELT_ATTR_STRUCK); break;
+	case 22: tsgrmode(0, XELT_ATTR_BOLD_FAINT); break;
+	case 23: tsgrmode(0, XELT_ATTR_ITALIC); break;
+	case 24: tsgrmode(0, XELT_ATTR_UNDERLINE); break;
+	case 25: tsgrmode(0, XELT_ATTR_BLINK); break;
+	case 27: tsgrmode(0, XELT_ATTR_REVERSE); break;
+	case 28: tsgrmode(0, XELT_ATTR_INVISIBLE); break;
+	case 29: tsgrmode(0, XELT_ATTR_STRUCK); break;
+	case 38:
+	case 48:
+	case 58: /* underline colour, read but not drawn */
+		d->ext = p;
+		d->nsub = 0;
+		break;
+	case 39:
+		d->fg = defaultfg;
+		d->setfg = 1;
+		break;
+	case 49:
+		d->bg = defaultbg;
+		d->setbg = 1;
+		break;
+	case 59:
+		break;
+	default:
+		if (BETWEEN(p, 30, 37)) {
+			d->fg = p - 30;
+			d->setfg = 1;
+		} else if (BETWEEN(p, 40, 47)) {
+			d->bg = p - 40;
+			d->setbg = 1;
+		} else if (BETWEEN(p, 90, 97)) {
+			d->fg = p - 90 + 8;
+			d->setfg = 1;
+		} else if (BETWEEN(p, 100, 107)) {
+			d->bg = p - 100 + 8;
+			d->setbg = 1;
+		} else {
+			d->unknown = 1;
+		}
+		break;
+	}
+}
+
+/*
+ * Finish a 38, 48 or 58 colour: 5;n, 2;r;g;b, 5:n, 2:r:g:b or
+ * 2:id:r:g:b with its colour space id.
+ */
+void
+tsgrext(void)
+{
+	xelt_SGRDelta *d = &csiescseq.sgr;
+	int *s = d->sub, n = d->nsub;
+	uint32_t col;
+
+	if (n == 2 && s[0] == 5 && BETWEEN(s[1], 0, 255)) {
+		col = s[1];
+	} else if (n >= 4 && s[0] == 2) {
+		s += (n >= 5) ? 2 : 1;
+		if (!BETWEEN(s[0], 0, 255) || !BETWEEN(s[1], 0, 255)
+				|| !BETWEEN(s[2], 0, 255)) {
+			d->unknown = 1;
+			d->ext = 0;
+			return;
+		}
+		col = TRUECOLOR(s[0], s[1], s[2]);
+	} else {
+		d->unknown = 1;
+		d->ext = 0;
+		return;
+	}
+
+	if (d->ext == 38) {
+		d->fg = col;
+		d->setfg = 1;
+	} else if (d->ext == 48) {
+		d->bg = col;
+		d->setbg = 1;
+	}
+	d->ext = 0;
+}
+
+/*
+ * Apply the SGR to the cursor attributes in one step.
+ */
+void
+tsgrapply(void)
+{
+	xelt_SGRDelta *d = &csiescseq.sgr;
+	xelt_Glyph *attr = &terminal.cursor.attr;
+
+	if (d->ext)
+		tsgrext();
+	attr->mode = (attr->mode & ~d->clear) | d->set;
+	if (d->setfg)
+		attr->fg = d->fg;
+	if (d->setbg)
+		attr->bg = d->bg;
+
+	if (d->unknown) {
+		fprintf(stderr, "erresc: unknown gfx attr ");
+		csidump();
+	}
+}
+
+void
+tsetscroll(int t, int b)
+{
+	int temp;
+
+	LIMIT(t, 0, terminal.row-1);
+	LIMIT(b, 0, terminal.row-1);
+	if (t > b) {
+		temp = t;
+		t = b;
+		b = temp;
+	}
+	terminal.top = t;
+	terminal.bot = b;
+}
+
+void
+tsetmargins(int l, int r)
+{
+	LIMIT(l, 0, terminal.col-1);
+	LIMIT(r, 0, terminal.col-1);
+	if (l >= r)
+		return;
+	terminal.left = l;
+	terminal.right = r;
+}
+
+void
+tsetmode(int priv, int set, int *args, int narg)
+{
+	int *lim, mode;
+	int alt;
+
+	for (lim = args + narg; args < lim; ++args) {
+		if (priv) {
+			switch (*args) {
+			case 1: /* DECCKM -- Cursor key */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_APPCURSOR);
+				break;
+			case 5: /* DECSCNM -- Reverse video */
+				mode = terminal.mode;
+				MODBIT(terminal.mode, set, XELT_TERMINAL_REVERSE);
+				if (mode != terminal.mode)
+					tredraw();
+				break;
+			case 6: /* DECOM -- Origin */
+				MODBIT(terminal.cursor.state, set, XELT_CURSOR_ORIGIN);
+				tmoveato(0, 0);
+				break;
+			case 7: /* DECAWM -- Auto wrap */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_WRAP);
+				break;
+			case 0:  /* Error (IGNORED) */
+			case 2:  /* DECANM -- ANSI/VT52 (IGNORED) */
+			case 3:  /* DECCOLM -- Column  (IGNORED) */
+			case 4:  /* DECSCLM -- Scroll (IGNORED) */
+			case 8:  /* DECARM -- Auto repeat (IGNORED) */
+			case 18: /* DECPFF -- Printer feed (IGNORED) */
+			case 19: /* DECPEX -- Printer extent (IGNORED) */
+			case 42: /* DECNRCM -- National characters (IGNORED) */
+			case 12: /* att610 -- Start blinking cursor (IGNORED) */
+				break;
+			case 25: /* DECTCEM -- Text Cursor Enable Mode */
+				MODBIT(terminal.mode, !set, XELT_TERMINAL_HIDE);
+				break;
+			case 9:    /* X10 mouse compatibility mode */
+				if (termcb.setpointermotion)
+					termcb.setpointermotion(0);
+				MODBIT(terminal.mode, 0, XELT_TERMINAL_MOUSE);
+				MODBIT(terminal.mode, set, XELT_TERMINAL_MOUSEX10);
+				break;
+			case 1000: /* 1000: report button press */
+				if (termcb.setpointermotion)
+					termcb.setpointermotion(0);
+				MODBIT(terminal.mode, 0, XELT_TERMINAL_MOUSE);
+				MODBIT(terminal.mode, set, XELT_TERMINAL_MOUSEBTN);
+				break;
+			case 1002: /* 1002: report motion on button press */
+				if (termcb.setpointermotion)
+					termcb.setpointermotion(0);
+				MODBIT(terminal.mode, 0, XELT_TERMINAL_MOUSE);
+				MODBIT(terminal.mode, set, XELT_TERMINAL_MOUSEMOTION);
+				break;
+			case 1003: /* 1003: enable all mouse motions */
+				if (termcb.setpointermotion)
+					termcb.setpointermotion(set);
+				MODBIT(terminal.mode, 0, XELT_TERMINAL_MOUSE);
+				MODBIT(terminal.mode, set, XELT_TERMINAL_MOUSEMANY);
+				break;
+			case 1004: /* 1004: send evhandler_focus events to tty */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_FOCUS);
+				break;
+			case 1006: /* 1006: extended reporting mode */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_MOUSESGR);
+				break;
+			case 1034:
+				MODBIT(terminal.mode, set, XELT_TERMINAL_8BIT);
+				break;
+			case 1049: /* swap screen & set/restore cursor as xterm */
+				if (!allowaltscreen)
+					break;
+				tcursor((set) ? XELT_CURSOR_SAVE : XELT_CURSOR_LOAD);
+				/* FALLTHROUGH */
+			case 47: /* swap screen */
+			case 1047:
+				if (!allowaltscreen)
+					break;
+				alt = IS_SET(XELT_TERMINAL_ALTSCREEN);
+				if (alt) {
+					tclearregion(0, 0, terminal.col-1,
+							terminal.row-1);
+				}
+				if (set ^ alt) /* set is always 1 or 0 */
+					tswapscreen();
+				if (*args != 1049)
+					break;
+				/* FALLTHROUGH */
+			case 1048:
+				tcursor((set) ? XELT_CURSOR_SAVE : XELT_CURSOR_LOAD);
+				break;
+			case 2004: /* 2004: bracketed paste mode */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_BRCKTPASTE);
+				break;
+			case 69: /* DECLRMM -- Left right margin mode */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_LRMM);
+				if (!set)
+					tsetmargins(0, terminal.col-1);
+				break;
+			case 2026: /* 2026: synchronized update, frames held */
+				if (set && !IS_SET(XELT_TERMINAL_SYNC))
+					clock_gettime(CLOCK_MONOTONIC, &terminal.synctime);
+				MODBIT(terminal.mode, set, XELT_TERMINAL_SYNC);
+				break;
+			/* Not implemented mouse modes. See comments there. */
+			case 1001: /* mouse highlight mode; can hang the
+				      terminal by design when implemented. */
+			case 1005: /* UTF-8 mouse mode; will confuse
+				      applications not supporting UTF-8
+				      and luit. */
+			case 1015: /* urxvt mangled mouse mode; incompatible
+				      and can be mistaken for other control
+				      codes. */
+			default:
+				fprintf(stderr,
+					"erresc: unknown private set/reset mode %d\n",
+					*args);
+				break;
+			}
+		} else {
+			switch (*args) {
+			case 0:  /* Error (IGNORED) */
+				break;
+			case 2:  /* KAM -- keyboard action */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_KBDLOCK);
+				break;
+			case 4:  /* IRM -- Insertion-replacement */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_INSERT);
+				break;
+			case 12: /* SRM -- Send/Receive */
+				MODBIT(terminal.mode, !set, XELT_TERMINAL_ECHO);
+				break;
+			case 20: /* LNM -- Linefeed/new line */
+				MODBIT(terminal.mode, set, XELT_TERMINAL_CRLF);
+				break;
+			default:
+				fprintf(stderr,
+					"erresc: unknown set/reset mode %d\n",
+					*args);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * State of a mode for DECRQM: 1 set, 2 reset, 0 not recognized.
+ */
+int
+tgetmode(int priv, int arg)
+{
+	int set;
+
+	if (priv) {
+		switch (arg) {
+		case 1:    set = IS_SET(XELT_TERMINAL_APPCURSOR); break;
+		case 5:    set = IS_SET(XELT_TERMINAL_REVERSE); break;
+		case 6:    set = terminal.cursor.state & XELT_CURSOR_ORIGIN; break;
+		case 7:    set = IS_SET(XELT_TERMINAL_WRAP); break;
+		case 9:    set = IS_SET(XELT_TERMINAL_MOUSEX10); break;
+		case 25:   set = !IS_SET(XELT_TERMINAL_HIDE); break;
+		case 69:   set = IS_SET(XELT_TERMINAL_LRMM); break;
+		case 47:
+		case 1047:
+		case 1049: set = IS_SET(XELT_TERMINAL_ALTSCREEN); break;
+		case 1000: set = IS_SET(XELT_TERMINAL_MOUSEBTN); break;
+		case 1002: set = IS_SET(XELT_TERMINAL_MOUSEMOTION); break;
+		case 1003: set = IS_SET(XELT_TERMINAL_MOUSEMANY); break;
+		case 1004: set = IS_SET(XELT_TERMINAL_FOCUS); break;
+		case 1006: set = IS_SET(XELT_TERMINAL_MOUSESGR); break;
+		case 1034: set = IS_SET(XELT_TERMINAL_8BIT); break;
+		case 2004: set = IS_SET(XELT_TERMINAL_BRCKTPASTE); break;
+		case 2026: set = IS_SET(XELT_TERMINAL_SYNC); break;
+		default:   return 0;
+		}
+	} else {
+		switch (arg) {
+		case 2:    set = IS_SET(XELT_TERMINAL_KBDLOCK); break;
+		case 4:    set = IS_SET(XELT_TERMINAL_INSERT); break;
+		case 12:   set = !IS_SET(XELT_TERMINAL_ECHO); break;
+		case 20:   set = IS_SET(XELT_TERMINAL_CRLF); break;
+		default:   return 0;
+		}
+	}
+
+	return set ? 1 : 2;
+}
+
+void
+csihandle(void)
+{
+	char buf[40];
+	int len, x1, y1, x2, y2, dx, dy, dx2, dy2, dst[4] = { 0 };
+
+	termstats.csi++;
+	if (csiescseq.sub && csiescseq.mode[0] != 'm')
+		goto unknown;
+	switch (csiescseq.mode[0]) {
+	default:
+	unknown:
+		fprintf(stderr, "erresc: unknown csi ");
+		csidump();
+		/* printAndExit(""); */
+		break;
+	case '@': /* ICH -- Insert <n> blank char */
+		DEFAULT(csiescseq.arg[0], 1);
+		tinsertblank(csiescseq.arg[0]);
+		break;
+	case 'A': /* CUU -- Cursor <n> Up */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveto(terminal.cursor.x, terminal.cursor.y-csiescseq.arg[0]);
+		break;
+	case 'B': /* CUD -- Cursor <n> Down */
+	case 'e': /* VPR --Cursor <n> Down */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveto(terminal.cursor.x, terminal.cursor.y+csiescseq.arg[0]);
+		break;
+	case 'i': /* MC -- Media Copy */
+		switch (csiescseq.arg[0]) {
+		case 0:
+			tdump();
+			break;
+		case 1:
+			tdumpline(terminal.cursor.y);
+			break;
+		case 2:
+			tdumpsel();
+			break;
+		case 4:
+			terminal.mode &= ~XELT_TERMINAL_PRINT;
+			break;
+		case 5:
+			terminal.mode |= XELT_TERMINAL_PRINT;
+			break;
+		}
+		break;
+	case 'c': /* DA -- Device Attributes */
+		if (csiescseq.arg[0] == 0)
+			ttywrite1(vtiden, sizeof(vtiden) - 1);
+		break;
+	case 'C': /* CUF -- Cursor <n> Forward */
+	case 'a': /* HPR -- Cursor <n> Forward */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveto(terminal.cursor.x+csiescseq.arg[0], terminal.cursor.y);
+		break;
+	case 'D': /* CUB -- Cursor <n> Backward */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveto(terminal.cursor.x-csiescseq.arg[0], terminal.cursor.y);
+		break;
+	case 'E': /* CNL -- Cursor <n> Down and first col */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveto(0, terminal.cursor.y+csiescseq.arg[0]);
+		break;
+	case 'F': /* CPL -- Cursor <n> Up and first col */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveto(0, terminal.cursor.y-csiescseq.arg[0]);
+		break;
+	case 'g': /* TBC -- Tabulation clear */
+		switch (csiescseq.arg[0]) {
+		case 0: /* clear current tab stop */
+			terminal.tabs[terminal.cursor.x] = 0;
+			break;
+		case 3: /* clear all the tabs */
+			memset(terminal.tabs, 0, terminal.col * sizeof(*terminal.tabs));
+			break;
+		default:
+			goto unknown;
+		}
+		break;
+	case 'G': /* CHA -- Move to <col> */
+	case '`': /* HPA */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveto(csiescseq.arg[0]-1, terminal.cursor.y);
+		break;
+	case 'H': /* CUP -- Move to <row> <col> */
+	case 'f': /* HVP */
+		DEFAULT(csiescseq.arg[0], 1);
+		DEFAULT(csiescseq.arg[1], 1);
+		tmoveato(csiescseq.arg[1]-1, csiescseq.arg[0]-1);
+		break;
+	case 'I': /* CHT -- Cursor Forward Tabulation <n> tab stops */
+		DEFAULT(csiescseq.arg[0], 1);
+		tputtab(csiescseq.arg[0]);
+		break;
+	case 'J': /* ED -- Clear screen */
+		selclear();
+		switch (csiescseq.arg[0]) {
+		case 0: /* below */
+			tclearregion(terminal.cursor.x, terminal.cursor.y, terminal.col-1, terminal.cursor.y);
+			if (terminal.cursor.y < terminal.row-1) {
+				tclearregion(0, terminal.cursor.y+1, terminal.col-1,
+						terminal.row-1);
+			}
+			break;
+		case 1: /* above */
+			if (terminal.cursor.y > 1)
+				tclearregion(0, 0, terminal.col-1, terminal.cursor.y-1);
+			tclearregion(0, terminal.cursor.y, terminal.cursor.x, terminal.cursor.y);
+			break;
+		case 2: /* all */
+			tclearregion(0, 0, terminal.col-1, terminal.row-1);
+			break;
+		default:
+			goto unknown;
+		}
+		break;
+	case 'K': /* EL -- Clear line */
+		switch (csiescseq.arg[0]) {
+		case 0: /* right */
+			tclearregion(terminal.cursor.x, terminal.cursor.y, terminal.col-1,
+					terminal.cursor.y);
+			break;
+		case 1: /* left */
+			tclearregion(0, terminal.cursor.y, terminal.cursor.x, terminal.cursor.y);
+			break;
+		case 2: /* all */
+			tclearregion(0, terminal.cursor.y, terminal.col-1, terminal.cursor.y);
+			break;
+		}
+		break;
+	case 'S': /* SU -- Scroll <n> line up */
+		DEFAULT(csiescseq.arg[0], 1);
+		tscrollup(terminal.top, csiescseq.arg[0]);
+		break;
+	case 'T': /* SD -- Scroll <n> line down */
+		DEFAULT(csiescseq.arg[0], 1);
+		tscrolldown(terminal.top, csiescseq.arg[0]);
+		break;
+	case 'L': /* IL -- Insert <n> blank lines */
+		DEFAULT(csiescseq.arg[0], 1);
+		tinsertblankline(csiescseq.arg[0]);
+		break;
+	case 'l': /* RM -- Reset Mode */
+		tsetmode(csiescseq.priv, 0, csiescseq.arg, csiescseq.narg);
+		break;
+	case 'M': /* DL -- Delete <n> lines */
+		DEFAULT(csiescseq.arg[0], 1);
+		tdeleteline(csiescseq.arg[0]);
+		break;
+	case 'X': /* ECH -- Erase <n> char */
+		DEFAULT(csiescseq.arg[0], 1);
+		tclearregion(terminal.cursor.x, terminal.cursor.y,
+				terminal.cursor.x + csiescseq.arg[0] - 1, terminal.cursor.y);
+		break;
+	case 'P': /* DCH -- Delete <n> char */
+		DEFAULT(csiescseq.arg[0], 1);
+		tdeletechar(csiescseq.arg[0]);
+		break;
+	case 'Z': /* CBT -- Cursor Backward Tabulation <n> tab stops */
+		DEFAULT(csiescseq.arg[0], 1);
+		tputtab(-csiescseq.arg[0]);
+		break;
+	case 'd': /* VPA -- Move to <row> */
+		DEFAULT(csiescseq.arg[0], 1);
+		tmoveato(terminal.cursor.x, csiescseq.arg[0]-1);
+		break;
+	case 'h': /* SM -- Set terminal mode */
+		tsetmode(csiescseq.priv, 1, csiescseq.arg, csiescseq.narg);
+		break;
+	case 'm': /* SGR -- Terminal colors (Select Graphic Rendition)  */
+		if (csiescseq.priv || csiescseq.mode[1])
+			goto unknown;
+		tsgrapply();
+		break;
+	case 't': /* XTWINOPS, the sizes sixel images are made for */
+		if (csiescseq.arg[0] == 14) {
+			len = snprintf(buf, sizeof(buf), "\033[4;%d;%dt",
+					terminal.row * terminal.ch,
+					terminal.col * terminal.cw);
+			ttywrite1(buf, len);
+		} else if (csiescseq.arg[0] == 16) {
+			len = snprintf(buf, sizeof(buf), "\033[6;%d;%dt",
+					terminal.ch, terminal.cw);
+			ttywrite1(buf, len);
+		}
+		break;
+	case 'n': /* DSR – Device Status Report (cursor position) */
+		if (csiescseq.arg[0] == 6) {
+			len = snprintf(buf, sizeof(buf),"\033[%i;%iR",
+					terminal.cursor.y+1, terminal.cursor.x+1);
+			ttywrite1(buf, len);
+		}
+		break;
+	case 'r': /* DECSTBM -- Set Scrolling Region */
+		if (csiescseq.priv) {
+			goto unknown;
+		} else {
+			DEFAULT(csiescseq.arg[0], 1);
+			DEFAULT(csiescseq.arg[1], terminal.row);
+			tsetscroll(csiescseq.arg[0]-1, csiescseq.arg[1]-1);
+			tmoveato(0, 0);
+		}
+		break;
+	case 's': /* DECSC -- Save cursor position (ANSI.SYS) */
+		if (IS_SET(XELT_TERMINAL_LRMM)) {
+			/* DECSLRM -- Set left and right margins */
+			DEFAULT(csiescseq.arg[0], 1);
+			DEFAULT(csiescseq.arg[1], terminal.col);
+			tsetmargins(csiescseq.arg[0]-1, csiescseq.arg[1]-1);
+			tmoveato(0, 0);
+			break;
+		}
+		tcursor(XELT_CURSOR_SAVE);
+		break;
+	case 'u': /* DECRC -- Restore cursor position (ANSI.SYS) */
+		tcursor(XELT_CURSOR_LOAD);
+		break;
+	case '$':
+		switch (csiescseq.mode[1]) {
+		case 'p': /* DECRQM -- Request mode */
+			len = snprintf(buf, sizeof(buf), "\033[%s%d;%d$y",
+					csiescseq.priv ? "?" : "", csiescseq.arg[0],
+					tgetmode(csiescseq.priv, csiescseq.arg[0]));
+			ttywrite1(buf, len);
+			break;
+		case 'v': /* DECCRA -- Copy rectangular area */
+			if (csiescseq.priv)
+				goto unknown;
+			/* the destination is a top, left pair, pages are ignored */
+			dst[0] = csiescseq.arg[5];
+			dst[1] = csiescseq.arg[6];
+			if (trect(csiescseq.arg, &x1, &y1, &x2, &y2)
+					&& trect(dst, &dx, &dy, &dx2, &dy2))
+				tcopyrect(x1, y1, x2, y2, dx, dy);
+			break;
+		case 'x': /* DECFRA -- Fill rectangular area */
+			if (csiescseq.priv)
+				goto unknown;
+			if (!BETWEEN(csiescseq.arg[0], 32, 126)
+					&& !BETWEEN(csiescseq.arg[0], 160, 255))
+				break;
+			if (trect(&csiescseq.arg[1], &x1, &y1, &x2, &y2))
+				tfillrect(x1, y1, x2, y2, csiescseq.arg[0]);
+			break;
+		case 'z': /* DECERA -- Erase rectangular area */
+			if (csiescseq.priv)
+				goto unknown;
+			if (trect(csiescseq.arg, &x1, &y1, &x2, &y2))
+				tclearregion(x1, y1, x2, y2);
+			break;
+		case '{': /* DECSERA -- Selective erase rectangular area */
+			if (csiescseq.priv)
+				goto unknown;
+			if (trect(csiescseq.arg, &x1, &y1, &x2, &y2))
+				tsclearregion(x1, y1, x2, y2);
+			break;
+		default:
+			goto unknown;
+		}
+		break;
+	case '"':
+		switch (csiescseq.mode[1]) {
+		case 'q': /* DECSCA -- Select character protection attribute */
+			switch (csiescseq.arg[0]) {
+			case 1:
+				terminal.cursor.attr.mode |= XELT_ATTR_PROTECTED;
+				break;
+			case 0:
+			case 2:
+				terminal.cursor.attr.mode &= ~XELT_ATTR_PROTECTED;
+				break;
+			default:
+				goto unknown;
+			}
+			break;
+		default:
+			goto unknown;
+		}
+		break;
+	case ' ':
+		switch (csiescseq.mode[1]) {
+		case 'q': /* DECSCUSR -- Set Cursor Style */
+			DEFAULT(csiescseq.arg[0], 1);
+			if (!BETWEEN(csiescseq.arg[0], 0, 6)) {
+				goto unknown;
+			}
+			if (termcb.setcursorstyle)
+				termcb.setcursorstyle(csiescseq.arg[0]);
+			break;
+		default:
+			goto unknown;
+		}
+		break;
+	}
+}
+
+void
+csidump(void)
+{
+	int i;
+	xelt_uint c;
+
+	printf("ESC[");
+	for (i = 0; i < csiescseq.len; i++) {
+		c = csiescseq.buf[i] & 0xff;
+		if (isprint(c)) {
+			putchar(c);
+		} else if (c == '\n') {
+			printf("(\\n)");
+		} else if (c == '\r') {
+			printf("(\\r)");
+		} else if (c == 0x1b) {
+			printf("(\\e)");
+		} else {
+			printf("(%02x)", c);
+		}
+	}
+	putchar('\n');
+}
+
+void
+csireset(void)
+{
+	memset(&csiescseq, 0, sizeof(csiescseq));
+}
+
+void
+strhandle(void)
+{
+	char *p = NULL;
+	int j, narg, par;
+
+	terminal.esc &= ~(XELT_ESC_STR_END|XELT_ESC_STR);
+	if (strescseq.over) {
+		fprintf(stderr, "erresc: ESC%c string over %zu bytes dropped\n",
+				strescseq.type, strmax);
+		return;
+	}
+	strparse();
+	par = (narg = strescseq.narg) ? atoi(strescseq.args[0]) : 0;
+
+	if (strescseq.type == ']')
+		termstats.osc++;
+	else if (strescseq.type == 'P')
+		termstats.dcs++;
+	else
+		termstats.apc++;
+
+	switch (strescseq.type) {
+	case ']': /* OSC -- Operating System Command */
+		switch (par) {
+		case 0:
+		case 1:
+		case 2:
+			if (narg > 1 && termcb.settitle)
+				termcb.settitle(strescseq.args[1]);
+			return;
+		case 8: /* hyperlink, params;URI, no URI ends it */
+			if (narg < 3)
+				break;
+			/* the URI may contain ';' */
+			for (j = 3; j < narg; j++)
+				strescseq.args[j][-1] = ';';
+			strescseq.args[2][-1] = ';';
+			terminal.cursor.attr.link = strescseq.args[2][0] ?
+				tlinkid(strescseq.args[1]) : 0;
+			return;
+		case 52: /* selection, its payload was decoded */
+			tosc52end(narg > 1 ? strescseq.args[1] : "");
+			return;
+		case 1337: /* iTerm2, only inline images */
+			if (strescseq.image)
+				tinlineend();
+			return;
+		case 4: /* color set */
+			if (narg < 3)
+				break;
+			p = strescseq.args[2];
+			/* FALLTHROUGH */
+		case 104: /* color reset, here p = NULL */
+			j = (narg > 1) ? atoi(strescseq.args[1]) : -1;
+			if (termcb.setcolorname && termcb.setcolorname(j, p)) {
+				fprintf(stderr, "erresc: invalid color %s\n", p);
+			} else {
+				/*
+				 * TODO if defaultbg color is changed, borders
+				 * are dirty
+				 */
+				tredraw();
+			}
+			return;
+		}
+		break;
+	case 'k': /* old title set compatibility */
+		if (termcb.settitle)
+			termcb.settitle(strescseq.args[0]);
+		return;
+	case 'P': /* DCS -- Device Control String */
+		if (strescseq.image)
+			tsixelend();
+		return;
+	case '_': /* APC -- Application Program Command */
+	case '^': /* PM -- Privacy Message */
+		return;
+	}
+
+	fprintf(stderr, "erresc: unknown str ");
+	strdump();
+}
+
+/*
+ * Split the string at the ';' noted by tputc(), in place. The last arg
+ * keeps the ';' past XELT_SIZE_STR_ARG args.
+ */
+void
+strparse(void)
+{
+	char *p = strescseq.buf;
+	int i;
+
+	strescseq.narg = 0;
+	if (strescseq.len == 0)
+		return;
+	p[strescseq.len] = '\0';
+
+	strescseq.args[strescseq.narg++] = p;
+	for (i = 0; i < strescseq.nsep; i++) {
+		p[strescseq.sep[i]] = '\0';
+		strescseq.args[strescseq.narg++] = p + strescseq.sep[i] + 1;
+	}
+}
+
+/*
+ * Room for n more bytes and a NUL in strescseq.buf, which doubles as
+ * needed. 0 when it would go over strmax, the sequence is then dropped.
+ */
+int
+strgrow(size_t n)
+{
+	size_t need = strescseq.len + n + 1, size = strescseq.size;
+
+	if (need <= size)
+		return 1;
+	if (need > strmax) {
+		strescseq.over = 1;
+		return 0;
+	}
+	while (size < need)
+		size = size ? 2 * size : XELT_SIZE_STR_BUF;
+	strescseq.size = MIN(size, strmax);
+	strescseq.buf = xrealloc(strescseq.buf, strescseq.size);
+	return 1;
+}
+
+/* FNV-1a of the string of a hyperlink */
+uint32_t
+tlinkhash(const char *s)
+{
+	uint32_t h = 2166136261U;
+
+	for (; *s; s++)
+		h = (h ^ (xelt_uchar)*s) * 16777619U;
+	return h;
+}
+
+/*
+ * Id of the hyperlink s, "params;URI", interned on first use. Two links
+ * with the same URI and id parameter share it. When the ids or linkmax
+ * bytes are all taken, the ones no cell holds are freed; 0 if that
+ * isn't enough.
+ */
+int
+tlinkid(char *s)
+{
+	xelt_LinkTable *lt = &terminal.links;
+	size_t len = strlen(s) + 1;
+	int i, id, mask = lt->hashsize - 1;
+
+	for (i = tlinkhash(s) & mask; lt->hashsize && (id = lt->hash[i]);
+			i = (i + 1) & mask) {
+		if (!strcmp(lt->str[id], s))
+			return id;
+	}
+	if ((lt->n == XELT_SIZE_LINKS && !lt->nfree)
+			|| lt->bytes + len > linkmax)
+		tlinksweep();
+	if ((lt->n == XELT_SIZE_LINKS && !lt->nfree)
+			|| lt->bytes + len > linkmax)
+		return 0;
+
+	/* the hash table stays at most half full */
+	if (!lt->nfree && 2 * (lt->n + 2) > lt->hashsize) {
+		free(lt->hash);
+		lt->hashsize = lt->hashsize ? 2 * lt->hashsize : 64;
+		lt->hash = xmalloc(lt->hashsize * sizeof(*lt->hash));
+		memset(lt->hash, 0, lt->hashsize * sizeof(*lt->hash));
+		lt->str = xrealloc(lt->str, lt->hashsize / 2 * sizeof(*lt->str));
+		lt->freeids = xrealloc(lt->freeids,
+				lt->hashsize / 2 * sizeof(*lt->freeids));
+		for (id = 1; id < lt->n; id++)
+			tlinkinsert(id);
+	}
+	if (lt->n == 0)
+		lt->n = 1;
+	id = lt->nfree ? lt->freeids[--lt->nfree] : lt->n++;
+	lt->str[id] = xstrdup(s);
+	lt->bytes += len;
+	tlinkinsert(id);
+	return id;
+}
+
+void
+tlinkinsert(int id)
+{
+	xelt_LinkTable *lt = &terminal.links;
+	int i, mask = lt->hashsize - 1;
+
+	for (i = tlinkhash(lt->str[id]) & mask; lt->hash[i]; i = (i + 1) & mask)
+		;
+	lt->hash[i] = id;
+}
+
+/*
+ * Free the hyperlinks no cell of the screens, nor the cursor or a saved
+ * cursor, holds. Their ids are given again by tlinkid().
+ */
+void
+tlinksweep(void)
+{
+	xelt_LinkTable *lt = &terminal.links;
+	xelt_Line *screen[2] = { terminal.line, terminal.alt }, line;
+	char *used;
+	int i, x, y, id;
+
+	if (lt->n == 0)
+		return;
+	used = xmalloc(lt->n);
+	memset(used, 0, lt->n);
+	used[terminal.cursor.attr.link] = 1;
+	used[terminal.saved[0].attr.link] = 1;
+	used[terminal.saved[1].attr.link] = 1;
+	for (i = 0; i < 2; i++) {
+		for (y = 0; y < terminal.row; y++) {
+			line = screen[i][y];
+			/* a lazy row is blank, its cells are stale */
+			if (line[terminal.col].mode & XELT_ATTR_LAZY)
+				continue;
+			for (x = 0; x < terminal.col; x++)
+				used[line[x].link] = 1;
+		}
+	}
+
+	memset(lt->hash, 0, lt->hashsize * sizeof(*lt->hash));
+	for (id = 1; id < lt->n; id++) {
+		if (!lt->str[id])
+			continue;
+		if (used[id]) {
+			tlinkinsert(id);
+			continue;
+		}
+		lt->bytes -= strlen(lt->str[id]) + 1;
+		free(lt->str[id]);
+		lt->str[id] = NULL;
+		lt->freeids[lt->nfree++] = id;
+	}
+	free(used);
+}
+
+void
+tlinkfree(void)
+{
+	xelt_LinkTable *lt = &terminal.links;
+	int id;
+
+	for (id = 1; id < lt->n; id++)
+		free(lt->str[id]);
+	free(lt->str);
+	free(lt->hash);
+	free(lt->freeids);
+	memset(lt, 0, sizeof(*lt));
+}
+
+/* URI of the hyperlink id, NULL for none */
+const char *
+tlinkuri(int id)
+{
+	xelt_LinkTable *lt = &terminal.links;
+
+	if (id <= 0 || id >= lt->n || !lt->str[id])
+		return NULL;
+	return strchr(lt->str[id], ';') + 1;
+}
+
+/*
+ * Next character of a base64 payload, decoded into strescseq.data.
+ * Characters out of the alphabet, '=' among them, are skipped. Returns
+ * 0, with the data freed, once it is over max bytes.
+ */
+int
+tbase64put(xelt_CharCode u, size_t max)
+{
+	int v;
+
+	if (BETWEEN(u, 'A', 'Z'))
+		v = u - 'A';
+	else if (BETWEEN(u, 'a', 'z'))
+		v = u - 'a' + 26;
+	else if (BETWEEN(u, '0', '9'))
+		v = u - '0' + 52;
+	else if (u == '+')
+		v = 62;
+	else if (u == '/')
+		v = 63;
+	else
+		return 1;
+
+	strescseq.bits = strescseq.bits << 6 | v;
+	if ((strescseq.nbits += 6) < 8)
+		return 1;
+	strescseq.nbits -= 8;
+
+	if (strescseq.datalen == max) {
+		free(strescseq.data);
+		strescseq.data = NULL;
+		return 0;
+	}
+	/* one more byte for the NUL */
+	if (strescseq.datalen + 1 >= strescseq.datasize) {
+		strescseq.datasize = MIN(strescseq.datasize ?
+				2 * strescseq.datasize : BUFSIZ, max + 1);
+		strescseq.data = xrealloc(strescseq.data, strescseq.datasize);
+	}
+	strescseq.data[strescseq.datalen++] = strescseq.bits >> strescseq.nbits;
+	return 1;
+}
+
+/*
+ * Next character of the payload of OSC 52, "?" asks for the selection.
+ */
+void
+tosc52put(xelt_CharCode u)
+{
+	if (u == '?' && strescseq.datalen == 0 && strescseq.nbits == 0) {
+		strescseq.osc52 = XELT_OSC52_GET;
+		return;
+	}
+	if (strescseq.osc52 == XELT_OSC52_DECODE && !tbase64put(u, osc52max))
+		strescseq.osc52 = XELT_OSC52_OVER;
+}
+
+/*
+ * OSC 52 ended, hand its text over to the front end for the selections
+ * sel.
+ */
+void
+tosc52end(const char *sel)
+{
+	switch (strescseq.osc52) {
+	case XELT_OSC52_GET:
+		if (osc52read && termcb.getclipboard)
+			termcb.getclipboard(sel);
+		break;
+	case XELT_OSC52_OVER:
+		fprintf(stderr, "erresc: OSC 52 over %zu bytes dropped\n",
+				osc52max);
+		break;
+	case XELT_OSC52_DECODE:
+		if (!strescseq.data)
+			strescseq.data = xmalloc(1);
+		strescseq.data[strescseq.datalen] = '\0';
+		if (termcb.setclipboard) {
+			termcb.setclipboard(sel, strescseq.data, strescseq.datalen);
+			strescseq.data = NULL;
+		}
+		break;
+	}
+	free(strescseq.data);
+	strescseq.data = NULL;
+}
+
+/*
+ * Images: the sixels of DCS q and the files of OSC 1337 (iTerm2 inline
+ * images), PNG ones. Like OSC 52 the payload is decoded as it comes,
+ * never going through strescseq.buf. The image is kept in imgtab for
+ * the front end to draw, see timage(), and its cells hold its id in u
+ * and the row and column of their tile in fg, with XELT_ATTR_IMAGE set.
+ * Scrolling moves the cells, the image is never decoded again.
+ */
+
+/*
+ * u ends the params of a sixel DCS, 'q', or the args of the file of
+ * OSC 1337, ':'. Start decoding the image, 0 when there is none.
+ */
+int
+timagestart(xelt_CharCode u)
+{
+	/* VT340 colours, in percents */
+	static const xelt_uchar vt340[16][3] = {
+		{  0,  0,  0 }, { 20, 20, 80 }, { 80, 13, 13 }, { 20, 80, 20 },
+		{ 80, 20, 80 }, { 20, 80, 80 }, { 80, 80, 20 }, { 53, 53, 53 },
+		{ 26, 26, 26 }, { 33, 33, 60 }, { 60, 26, 26 }, { 33, 60, 33 },
+		{ 60, 33, 60 }, { 33, 60, 60 }, { 60, 60, 33 }, { 80, 80, 80 },
+	};
+	xelt_Sixel *s;
+	size_t i;
+
+	if (u == ':') {
+		if (strescseq.type != ']' || strescseq.len < 10
+				|| strncmp(strescseq.buf, "1337;File=", 10))
+			return 0;
+		strescseq.image = XELT_IMAGE_INLINE;
+		return 1;
+	}
+
+	if (strescseq.type != 'P')
+		return 0;
+	for (i = 0; i < strescseq.len; i++) {
+		if (!isdigit((xelt_uchar)strescseq.buf[i])
+				&& strescseq.buf[i] != ';')
+			return 0;
+	}
+	s = strescseq.sixel = xmalloc(sizeof(*s));
+	memset(s, 0, sizeof(*s));
+	for (i = 0; i < LEN(s->palette); i++) {
+		s->palette[i] = 0xff000000;
+		if (i < LEN(vt340)) {
+			s->palette[i] |= vt340[i][0] * 255 / 100 << 16
+				| vt340[i][1] * 255 / 100 << 8
+				| vt340[i][2] * 255 / 100;
+		}
+	}
+	strescseq.image = XELT_IMAGE_SIXEL;
+	return 1;
+}
+
+void
+timageput(xelt_CharCode u)
+{
+	switch (strescseq.image) {
+	case XELT_IMAGE_SIXEL:
+		tsixelput(u);
+		break;
+	case XELT_IMAGE_INLINE:
+		if (!tbase64put(u, imagemax))
+			strescseq.image = XELT_IMAGE_OVER;
+		break;
+	}
+}
+
+/*
+ * Keep data, an image of w x h pixels shown as dw x dh with the cells
+ * of the terminal. The oldest images go while they take more than
+ * imagemax bytes.
+ */
+const xelt_Image *
+timageadd(int kind, char *data, size_t len, int w, int h, int dw, int dh)
+{
+	xelt_Image *img;
+	int n;
+
+	if (!imgtab)
+		imgtab = xmalloc(XELT_SIZE_IMAGES * sizeof(*imgtab));
+	for (n = 0; n < nimgtab && (nimgtab - n >= XELT_SIZE_IMAGES
+				|| imgbytes + len > imagemax); n++) {
+		imgbytes -= imgtab[n].len;
+		free(imgtab[n].data);
+	}
+	memmove(imgtab, imgtab + n, (nimgtab - n) * sizeof(*imgtab));
+	nimgtab -= n;
+
+	img = &imgtab[nimgtab++];
+	/* 0 is never an id, even once they wrap */
+	if (imgnext == 0)
+		imgnext++;
+	img->id = imgnext++;
+	img->kind = kind;
+	img->data = data;
+	img->len = len;
+	img->w = w;
+	img->h = h;
+	img->dw = dw;
+	img->dh = dh;
+	img->cw = terminal.cw;
+	img->ch = terminal.ch;
+	img->cols = DIVCEIL(dw, terminal.cw);
+	img->rows = DIVCEIL(dh, terminal.ch);
+	imgbytes += len;
+	return img;
+}
+
+/* Image id, NULL once dropped */
+const xelt_Image *
+timage(uint32_t id)
+{
+	int lo = 0, hi = nimgtab - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (imgtab[mid].id == id)
+			return &imgtab[mid];
+		if (imgtab[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return NULL;
+}
+
+/*
+ * Fill the cells of img from the cursor down, scrolling like text. The
+ * cursor is left on the line below the image, or after its last row
+ * unless below.
+ */
+void
+timageplace(const xelt_Image *img, int below)
+{
+	xelt_Glyph g = terminal.cursor.attr;
+	int x0 = terminal.cursor.x, r, c;
+
+	g.mode = XELT_ATTR_IMAGE;
+	g.link = 0;
+	for (r = 0; r < img->rows; r++) {
+		if (r > 0)
+			tnewline(0);
+		for (c = 0; c < img->cols && x0 + c < terminal.col; c++) {
+			g.fg = r << 16 | c;
+			tsetchar(' ', &g, x0 + c, terminal.cursor.y);
+			terminal.line[terminal.cursor.y][x0 + c].u = img->id;
+		}
+	}
+	if (below)
+		tnewline(0);
+	else
+		tmoveto(x0 + img->cols, terminal.cursor.y);
+}
+
+/*
+ * Room for w x h pixels in the sixel image, 0 when it would take more
+ * than imagemax bytes: the image is then dropped.
+ */
+int
+tsixelgrow(int w, int h)
+{
+	xelt_Sixel *s = strescseq.sixel;
+	uint32_t *p;
+	int nw, nh, y;
+
+	if (w <= s->width && h <= s->height)
+		return 1;
+	nw = (w > s->width) ? MAX(w, 2 * s->width) : s->width;
+	nh = (h > s->height) ? MAX(h, 2 * s->height) : s->height;
+	if ((size_t)nw * nh > imagemax / 4) {
+		nw = MAX(w, s->width);
+		nh = MAX(h, s->height);
+	}
+	if ((size_t)nw * nh > imagemax / 4) {
+		free(s->pixels);
+		s->pixels = NULL;
+		strescseq.image = XELT_IMAGE_OVER;
+		return 0;
+	}
+
+	p = xmalloc((size_t)nw * nh * sizeof(*p));
+	memset(p, 0, (size_t)nw * nh * sizeof(*p));
+	for (y = 0; y < s->height; y++) {
+		memcpy(p + (size_t)y * nw, s->pixels + (size_t)y * s->width,
+				s->width * sizeof(*p));
+	}
+	free(s->pixels);
+	s->pixels = p;
+	s->width = nw;
+	s->height = nh;
+	return 1;
+}
+
+/* ARGB of the sixel colour hue, lightness, saturation, blue is 0 degree */
+uint32_t
+tsixelhls(int hue, int lum, int sat)
+{
+	int h = (hue + 240) % 360, c, x, m, r, g, b;
+
+	lum = MIN(lum, 100);
+	sat = MIN(sat, 100);
+	/* in percents */
+	c = (100 - abs(2 * lum - 100)) * sat / 100;
+	x = c * (60 - abs(h % 120 - 60)) / 60;
+	m = lum - c / 2;
+	switch (h / 60) {
+	case 0:  r = c; g = x; b = 0; break;
+	case 1:  r = x; g = c; b = 0; break;
+	case 2:  r = 0; g = c; b = x; break;
+	case 3:  r = 0; g = x; b = c; break;
+	case 4:  r = x; g = 0; b = c; break;
+	default: r = c; g = 0; b = x; break;
+	}
+	return 0xff000000 | (r + m) * 255 / 100 << 16
+		| (g + m) * 255 / 100 << 8 | (b + m) * 255 / 100;
+}
+
+/* The params of the introducer '#', '!' or '"' are read */
+void
+tsixelintro(void)
+{
+	xelt_Sixel *s = strescseq.sixel;
+	int *p = s->param, n = s->nparam + 1, c;
+
+	switch (s->intro) {
+	case '#': /* colour register Pc, set when Pc;Pu;Px;Py;Pz */
+		c = p[0] % XELT_SIZE_SIXEL_COLORS;
+		if (n >= 5 && p[1] == 1) {
+			s->palette[c] = tsixelhls(p[2], p[3], p[4]);
+		} else if (n >= 5 && p[1] == 2) {
+			s->palette[c] = 0xff000000
+				| MIN(p[2], 100) * 255 / 100 << 16
+				| MIN(p[3], 100) * 255 / 100 << 8
+				| MIN(p[4], 100) * 255 / 100;
+		}
+		s->color = c;
+		break;
+	case '!': /* repeat the next sixel */
+		s->repeat = MAX(p[0], 1);
+		break;
+	case '"': /* raster attributes Pan;Pad;Ph;Pv, the image size */
+		if (n >= 4 && p[2] > 0 && p[3] > 0 && tsixelgrow(p[2], p[3])) {
+			s->w = MAX(s->w, p[2]);
+			s->h = MAX(s->h, p[3]);
+		}
+		break;
+	}
+	s->intro = 0;
+}
+
+/*
+ * Next character of a sixel image, after the 'q' of its DCS. A sixel
+ * is six pixels of a column, drawn with the colour register in use.
+ */
+void
+tsixelput(xelt_CharCode u)
+{
+	xelt_Sixel *s = strescseq.sixel;
+	uint32_t *p, col;
+	int i, j, n, bits;
+
+	if (s->intro) {
+		if (BETWEEN(u, '0', '9')) {
+			s->param[s->nparam] = MIN(s->param[s->nparam] * 10
+					+ (int)(u - '0'), 0xffff);
+			return;
+		}
+		if (u == ';') {
+			if (s->nparam < LEN(s->param) - 1)
+				s->nparam++;
+			return;
+		}
+		tsixelintro();
+		if (strescseq.image != XELT_IMAGE_SIXEL)
+			return;
+	}
+
+	switch (u) {
+	case '#':
+	case '!':
+	case '"':
+		s->intro = u;
+		s->nparam = 0;
+		memset(s->param, 0, sizeof(s->param));
+		return;
+	case '$': /* back to the first column */
+		s->x = 0;
+		return;
+	case '-': /* next band of six rows */
+		s->x = 0;
+		s->y += 6;
+		return;
+	}
+	if (!BETWEEN(u, '?', '~'))
+		return;
+
+	n = s->repeat ? s->repeat : 1;
+	s->repeat = 0;
+	if (!tsixelgrow(s->x + n, s->y + 6))
+		return;
+	bits = u - '?';
+	col = s->palette[s->color];
+	for (i = 0; i < 6; i++) {
+		if (!(bits >> i & 1))
+			continue;
+		p = s->pixels + (size_t)(s->y + i) * s->width + s->x;
+		for (j = 0; j < n; j++)
+			p[j] = col;
+		s->h = MAX(s->h, s->y + i + 1);
+	}
+	s->x += n;
+	s->w = MAX(s->w, s->x);
+}
+
+/*
+ * The sixel DCS ended, keep its pixels and show them at the cursor.
+ */
+void
+tsixelend(void)
+{
+	xelt_Sixel *s = strescseq.sixel;
+	const xelt_Image *img;
+	int y, w, h;
+
+	if (strescseq.image == XELT_IMAGE_SIXEL && s->intro)
+		tsixelintro();
+	if (strescseq.image == XELT_IMAGE_OVER) {
+		fprintf(stderr, "erresc: sixel image over %zu bytes dropped\n",
+				imagemax);
+		return;
+	}
+	w = MIN(s->w, s->width);
+	h = MIN(s->h, s->height);
+	if (w == 0 || h == 0)
+		return;
+
+	/* rows of w pixels, in place */
+	for (y = 1; y < h; y++) {
+		memmove(s->pixels + (size_t)y * w, s->pixels
+				+ (size_t)y * s->width, w * sizeof(*s->pixels));
+	}
+	img = timageadd(XELT_IMAGE_ARGB, (char *)s->pixels,
+			(size_t)w * h * sizeof(*s->pixels), w, h, w, h);
+	s->pixels = NULL;
+	timageplace(img, 1);
+}
+
+/*
+ * Pixels of the width or height v of OSC 1337: N cells of size cell,
+ * Npx, N% of screen. 0 for auto.
+ */
+int
+tinlinesize(const char *v, int cell, int screen)
+{
+	char *end;
+	long n = strtol(v, &end, 10);
+
+	if (end == v || n <= 0)
+		return 0;
+	n = MIN(n, 1 << 15);
+	if (!strcmp(end, "px"))
+		return n;
+	if (!strcmp(end, "%"))
+		return MIN(n, 100) * screen / 100;
+	if (*end == '\0')
+		return MIN(n * cell, 1 << 15);
+	return 0;
+}
+
+/*
+ * OSC 1337 File=key=value;...:base64 ended. An inline=1 file is shown at
+ * the cursor when it is a PNG, the front end decodes it.
+ */
+void
+tinlineend(void)
+{
+	const xelt_uchar *d = (xelt_uchar *)strescseq.data;
+	const xelt_Image *img;
+	char *arg;
+	long dw = 0, dh = 0, w, h, sw;
+	int i, inl = 0, keep = 1;
+
+	if (strescseq.image == XELT_IMAGE_OVER) {
+		fprintf(stderr, "erresc: OSC 1337 file over %zu bytes dropped\n",
+				imagemax);
+		return;
+	}
+	for (i = 1; i < strescseq.narg; i++) {
+		arg = strescseq.args[i] + (i == 1 ? 5 : 0); /* File= */
+		if (!strncmp(arg, "inline=", 7))
+			inl = atoi(arg + 7);
+		else if (!strncmp(arg, "width=", 6))
+			dw = tinlinesize(arg + 6, terminal.cw, terminal.col * terminal.cw);
+		else if (!strncmp(arg, "height=", 7))
+			dh = tinlinesize(arg + 7, terminal.ch, terminal.row * terminal.ch);
+		else if (!strncmp(arg, "preserveAspectRatio=", 20))
+			keep = atoi(arg + 20);
+	}
+	/* a download, not shown */
+	if (!inl)
+		return;
+	if (strescseq.datalen < 24 || memcmp(d, "\211PNG\r\n\032\n", 8)
+			|| memcmp(d + 12, "IHDR", 4)) {
+		fprintf(stderr, "erresc: OSC 1337 file is not a PNG\n");
+		return;
+	}
+	w = (long)d[16] << 24 | d[17] << 16 | d[18] << 8 | d[19];
+	h = (long)d[20] << 24 | d[21] << 16 | d[22] << 8 | d[23];
+	if (w <= 0 || h <= 0 || w > (1 << 15) || h > (1 << 15)
+			|| (size_t)w * h > imagemax / 4) {
+		fprintf(stderr, "erresc: OSC 1337 image of %ldx%ld dropped\n",
+				w, h);
+		return;
+	}
+
+	/* a side not given follows the other, both fit the box given */
+	if (!dw && !dh) {
+		dw = w;
+		dh = h;
+	} else if (!dw) {
+		dw = keep ? w * dh / h : w;
+	} else if (!dh) {
+		dh = keep ? h * dw / w : h;
+	} else if (keep && dw * h > dh * w) {
+		dw = w * dh / h;
+	} else if (keep) {
+		dh = h * dw / w;
+	}
+	/* not wider than the screen */
+	sw = terminal.col * terminal.cw;
+	if (dw > sw) {
+		dh = dh * sw / dw;
+		dw = sw;
+	}
+
+	img = timageadd(XELT_IMAGE_PNG, strescseq.data, strescseq.datalen,
+			w, h, MAX(dw, 1), MAX(dh, 1));
+	strescseq.data = NULL;
+	timageplace(img, 0);
+}
+
+void
+strdump(void)
+{
+	size_t i;
+	xelt_uint c;
+
+	printf("ESC%c", strescseq.type);
+	for (i = 0; i < strescseq.len; i++) {
+		c = strescseq.buf[i] & 0xff;
+		if (c == '\0') {
+			return;
+		} else if (isprint(c)) {
+			putchar(c);
+		} else if (c == '\n') {
+			printf("(\\n)");
+		} else if (c == '\r') {
+			printf("(\\r)");
+		} else if (c == 0x1b) {
+			printf("(\\e)");
+		} else {
+			printf("(%02x)", c);
+		}
+	}
+	printf("ESC\\\n");
+}
+
+/*
+ * Forget the sequence and its payload. Its buffer is kept for the next
+ * one unless a long sequence made it grow.
+ */
+void
+strreset(void)
+{
+	char *buf = strescseq.buf;
+	size_t size = strescseq.size;
+
+	free(strescseq.data);
+	if (strescseq.sixel)
+		free(strescseq.sixel->pixels);
+	free(strescseq.sixel);
+
+	if (size > XELT_SIZE_STR_KEEP) {
+		free(buf);
+		buf = NULL;
+		size = 0;
+	}
+	memset(&strescseq, 0, sizeof(strescseq));
+	strescseq.buf = buf;
+	strescseq.size = size;
+}
+
+void
+tprinter(char *s, size_t len)
+{
+	if (iofd != -1 && xwrite(iofd, s, len) < 0) {
+		fprintf(stderr, "Error writing in %s:%s\n",
+			ioname, strerror(errno));
+		close(iofd);
+		iofd = -1;
+	}
+}
+
+void
+tdumpsel(void)
+{
+	char *ptr;
+
+	if ((ptr = getsel())) {
+		tprinter(ptr, strlen(ptr));
+		free(ptr);
+	}
+}
+
+void
+tdumpline(int n)
+{
+	char buf[XELT_SIZE_UTF];
+	xelt_Glyph *bp, *end;
+
+	tlinetouch(terminal.line[n]);
+	bp = &terminal.line[n][0];
+	end = &bp[MIN(tlinelen(n), terminal.col) - 1];
+	if (bp != end || GLYPHRUNE(*bp) != ' ') {
+		for ( ;bp <= end; ++bp)
+			tprinter(buf, utf8encode(GLYPHRUNE(*bp), buf));
+	}
+	tprinter("\n", 1);
+}
+
+void
+tdump(void)
+{
+	int i;
+
+	for (i = 0; i < terminal.row; ++i)
+		tdumpline(i);
+}
+
+void
+tputtab(int n)
+{
+	xelt_uint x = terminal.cursor.x;
+
+	if (n > 0) {
+		while (x < terminal.col && n--)
+			for (++x; x < terminal.col && !terminal.tabs[x]; ++x)
+				/* nothing */ ;
+	} else if (n < 0) {
+		while (x > 0 && n++)
+			for (--x; x > 0 && !terminal.tabs[x]; --x)
+				/* nothing */ ;
+	}
+	terminal.cursor.x = LIMIT(x, 0, terminal.col-1);
+}
+
+// void techo(xelt_CharCode u)
+// {
+	// char *me="techo";
+	// xelt_log(me,"started");
+	// if (ISCONTROL(u)) { /* control code */
+		// if (u & 0x80) {
+			// u &= 0x7f;
+			// tputc('^');
+			// tputc('[');
+		// } else if (u != '\n' && u != '\r' && u != '\t') {
+			// u ^= 0x40;
+			// tputc('^');
+		// }
+	// }
+	// tputc(u);
+// }
+
+void
+tdeftran(char ascii)
+{
+	static char cs[] = "0B";
+	static int vcs[] = {XELT_CHARSET_GRAPHIC0, XELT_CHARSET_USA};
+	char *p;
+
+	if ((p = strchr(cs, ascii)) == NULL) {
+		fprintf(stderr, "esc unhandled charset: ESC ( %c\n", ascii);
+	} else {
+		terminal.trantbl[terminal.icharset] = vcs[p - cs];
+	}
+}
+
+void
+tdectest(char c)
+{
+	int x, y;
+
+	if (c == '8') { /* DEC screen alignment test. */
+		for (x = 0; x < terminal.col; ++x) {
+			for (y = 0; y < terminal.row; ++y)
+				tsetchar('E', &terminal.cursor.attr, x, y);
+		}
+	}
+}
+
+void
+tstrsequence(xelt_uchar c)
+{
+	switch (c) {
+	case 0x90:   /* DCS -- Device Control String */
+		c = 'P';
+		break;
+	case 0x9f:   /* APC -- Application Program Command */
+		c = '_';
+		break;
+	case 0x9e:   /* PM -- Privacy Message */
+		c = '^';
+		break;
+	case 0x9d:   /* OSC -- Operating System Command */
+		c = ']';
+		break;
+	}
+	strreset();
+	strescseq.type = c;
+	terminal.esc |= XELT_ESC_STR;
+}
+
+void tcontrolcode(xelt_uchar ascii)
+{
+	xelt_ProfMark mark;
+
+	switch (ascii) {
+	case XELT_CTRLCODE_TAB:  
+		tputtab(1);
+		return;
+	case XELT_CTRLCODE_BACKSPACE:  
+		tmoveto(terminal.cursor.x-1, terminal.cursor.y);
+		return;
+	case XELT_CTRLCODE_CARRIAGERETURN: 
+		tmoveto(0, terminal.cursor.y);
+		return;
+	case XELT_CTRLCODE_FORMFEED:  
+	case XELT_CTRLCODE_VERTICALTAB:
+	case XELT_CTRLCODE_LINEFEED:
+		/* go to first col if the mode is set */
+		tnewline(IS_SET(XELT_TERMINAL_CRLF));
+		return;
+	case XELT_CTRLCODE_BELL:
+		if (terminal.esc & XELT_ESC_STR_END) {
+			/* backwards compatibility to xterm */
+			if (proftab)
+				tprofstart(&mark);
+			strhandle();
+			if (proftab)
+				tprofstr(&mark);
+		} else if (termcb.bell) {
+			termcb.bell();
+		}
+		break;
+	case XELT_CTRLCODE_ESC:
+		csireset();
+		terminal.esc &= ~(XELT_ESC_CSI|XELT_ESC_ALTCHARSET|XELT_ESC_TEST);
+		terminal.esc |= XELT_ESC_START;
+		return;
+	case XELT_CTRLCODE_SHIFTOUT:
+	case XELT_CTRLCODE_SHIFTIN:
+		terminal.charset = 1 - (ascii - XELT_CTRLCODE_SHIFTOUT);
+		return;
+	case XELT_CTRLCODE_SUBSTITUTECHAR:
+		tsetchar('?', &terminal.cursor.attr, terminal.cursor.x, terminal.cursor.y);
+	case XELT_CTRLCODE_CANCEL:
+		csireset();
+		break;
+	case XELT_CTRLCODE_DELETE:  
+		return;/* DEL (IGNORED) */
+	case XELT_CTRLCODE_NEXTLINE:
+		tnewline(1); /* always go to first col */
+		break;
+	case XELT_CTRLCODE_HORIZONTALTABSTOP:
+		terminal.tabs[terminal.cursor.x] = 1;
+		break;
+	case XELT_CTRLCODE_TERMINALID:
+		ttywrite1(vtiden, sizeof(vtiden) - 1);
+		break;
+	case XELT_CTRLCODE_DEVICECONTROLSTRING:
+	case XELT_CTRLCODE_OPERATINGSYSTEMCOMMAND:
+	case XELT_CTRLCODE_PRIVACYMESSAGE:
+	case XELT_CTRLCODE_APPLICATIONPROGRAMCOMMAND:
+		tstrsequence(ascii);
+		return;
+	}
+	/* only CAN, SUB, \a and C1 chars interrupt a sequence */
+	terminal.esc &= ~(XELT_ESC_STR_END|XELT_ESC_STR); // birdlang
+}
+
+/*
+ * returns 1 when the sequence is finished and it hasn't to read
+ * more characters for this sequence, otherwise 0
+ */
+int eschandle(xelt_uchar ascii)
+{
+	xelt_ProfMark mark;
+
+	switch (ascii) {
+	case '[': /* CSI - Control Sequence Introducer */
+		terminal.esc |= XELT_ESC_CSI;
+		return 0;
+	case '#':
+		terminal.esc |= XELT_ESC_TEST;
+		return 0;
+	case 'P': /* DCS -- Device Control String */
+	case '_': /* APC -- Application Program Command */
+	case '^': /* PM -- Privacy Message */
+	case ']': /* OSC -- Operating System Command */
+	case 'k': /* old title set compatibility */
+		tstrsequence(ascii);
+		return 0;
+	case 'n': /* LS2 -- Locking shift 2 */
+	case 'o': /* LS3 -- Locking shift 3 */
+		terminal.charset = 2 + (ascii - 'n');
+		break;
+	case '(': /* GZD4 -- set primary charset G0 */
+	case ')': /* G1D4 -- set secondary charset G1 */
+	case '*': /* G2D4 -- set tertiary charset G2 */
+	case '+': /* G3D4 -- set quaternary charset G3 */
+		terminal.icharset = ascii - '(';
+		terminal.esc |= XELT_ESC_ALTCHARSET;
+		return 0;
+	case 'D': /* IND -- Linefeed */
+		if (terminal.cursor.y == terminal.bot) {
+			tscrollup(terminal.top, 1);
+		} else {
+			tmoveto(terminal.cursor.x, terminal.cursor.y+1);
+		}
+		break;
+	case 'E': /* NEL -- Next line */
+		tnewline(1); /* always go to first col */
+		break;
+	case 'H': /* HTS -- Horizontal tab stop */
+		terminal.tabs[terminal.cursor.x] = 1;
+		break;
+	case 'M': /* RI -- Reverse index */
+		if (terminal.cursor.y == terminal.top) {
+			tscrolldown(terminal.top, 1);
+		} else {
+			tmoveto(terminal.cursor.x, terminal.cursor.y-1);
+		}
+		break;
+	case 'Z': /* DECID -- Identify Terminal */
+		ttywrite1(vtiden, sizeof(vtiden) - 1);
+		break;
+	case 'c': /* RIS -- Reset to inital state */
+		treset();
+		if (termcb.resettitle)
+			termcb.resettitle();
+		if (termcb.loadcolors)
+			termcb.loadcolors();
+		break;
+	case '=': /* DECPAM -- Application keypad */
+		terminal.mode |= XELT_TERMINAL_APPKEYPAD;
+		break;
+	case '>': /* DECPNM -- Normal keypad */
+		terminal.mode &= ~XELT_TERMINAL_APPKEYPAD;
+		break;
+	case '7': /* DECSC -- Save Cursor */
+		tcursor(XELT_CURSOR_SAVE);
+		break;
+	case '8': /* DECRC -- Restore Cursor */
+		tcursor(XELT_CURSOR_LOAD);
+		break;
+	case '\\': /* ST -- String Terminator */
+		if (terminal.esc & XELT_ESC_STR_END) {
+			if (proftab)
+				tprofstart(&mark);
+			strhandle();
+			if (proftab)
+				tprofstr(&mark);
+		}
+		break;
+	default:
+		fprintf(stderr, "erresc: unknown sequence ESC 0x%02X '%c'\n",
+			(xelt_uchar) ascii, isprint(ascii)? ascii:'.');
+		break;
+	}
+	return 1;
+}
+
+void
+tputc(xelt_CharCode u)
+{
+	char c[XELT_SIZE_UTF];
+	int control;
+	int width, len;
+	xelt_Glyph *gp;
+	xelt_ProfMark mark;
+
+	control = ISCONTROL(u);
+	len = utf8encode(u, c);
+	if (!control && (width = wcwidth(u)) == -1) {
+		memcpy(c, "\357\277\275", 4); /* XELT_SIZE_UTF_INVALID */
+		width = 1;
+	}
+
+	if (IS_SET(XELT_TERMINAL_PRINT))
+		tprinter(c, len);
+
+	/*
+	 * STR sequence must be checked before anything else
+	 * because it uses all following characters until it
+	 * receives a ESC, a SUB, a ST or any other C1 control
+	 * character.
+	 */
+	if (terminal.esc & XELT_ESC_STR) {
+		if (u == '\a' || u == 030 || u == 032 || u == 033 ||
+		   ISCONTROLC1(u)) {
+			terminal.esc &= ~(XELT_ESC_START|XELT_ESC_STR);
+			terminal.esc |= XELT_ESC_STR_END;
+		} else if (strescseq.osc52) {
+			tosc52put(u);
+			return;
+		} else if (strescseq.image) {
+			timageput(u);
+			return;
+		} else if (!strescseq.over && strgrow(len)) {
+			/* sixels and the file of OSC 1337 are decoded as they come */
+			if ((u == 'q' || u == ':') && timagestart(u))
+				return;
+			/* the args are split where strparse() finds them */
+			if (u == ';' && strescseq.nsep < LEN(strescseq.sep)) {
+				strescseq.sep[strescseq.nsep++] = strescseq.len;
+				/* 52;sel; is kept, the payload is decoded as it comes */
+				if (strescseq.nsep == 2 && strescseq.sep[0] == 2
+						&& strescseq.type == ']'
+						&& !strncmp(strescseq.buf, "52", 2))
+					strescseq.osc52 = XELT_OSC52_DECODE;
+			}
+			memcpy(&strescseq.buf[strescseq.len], c, len);
+			strescseq.len += len;
+			return;
+		} else {
+			/*
+			 * Over strmax: the rest is read up to the end of
+			 * the sequence, which strhandle() drops.
+			 */
+			return;
+		}
+	}
+
+	/*
+	 * Actions of control codes must be performed as soon they arrive
+	 * because they can be embedded inside a control sequence, and
+	 * they must not cause conflicts with sequences.
+	 */
+	if (control) {
+		tcontrolcode(u);
+		/*
+		 * control codes are not shown ever
+		 */
+		return;
+	} else if (terminal.esc & XELT_ESC_START) {
+		if (terminal.esc & XELT_ESC_CSI) {
+			csiescseq.buf[csiescseq.len++] = u;
+			csiput(u);
+			if (BETWEEN(u, 0x40, 0x7E)
+					|| csiescseq.len >= \
+					sizeof(csiescseq.buf)-1) {
+				terminal.esc = 0;
+				if (proftab)
+					tprofstart(&mark);
+				csiparse();
+				csihandle();
+				if (proftab)
+					tprofcsi(&mark);
+			}
+			return;
+		} else if (terminal.esc & XELT_ESC_ALTCHARSET) {
+			tdeftran(u);
+		} else if (terminal.esc & XELT_ESC_TEST) {
+			tdectest(u);
+		} else {
+			if (proftab)
+				tprofstart(&mark);
+			if (!eschandle(u))
+				return;
+			/* sequence already finished, ST is profiled as its string */
+			if (proftab && u != '\\')
+				tprofesc(u, &mark);
+		}
+		termstats.esc++;
+		terminal.esc = 0;
+		/*
+		 * All characters which form part of a sequence are not
+		 * printed
+		 */
+		return;
+	}
+	if (sel.ob.x != -1 && BETWEEN(terminal.cursor.y, sel.ob.y, sel.oe.y))
+		selclear();
+
+	tlinetouch(terminal.line[terminal.cursor.y]);
+	gp = &terminal.line[terminal.cursor.y][terminal.cursor.x];
+	if (IS_SET(XELT_TERMINAL_WRAP) && (terminal.cursor.state & XELT_CURSOR_WRAPNEXT)) {
+		gp->mode |= XELT_ATTR_WRAP;
+		terminal.line[terminal.cursor.y][terminal.col].u = 0;
+		tnewline(1);
+		tlinetouch(terminal.line[terminal.cursor.y]);
+		gp = &terminal.line[terminal.cursor.y][terminal.cursor.x];
+	}
+
+	if (IS_SET(XELT_TERMINAL_INSERT) && terminal.cursor.x+width < terminal.col)
+		memmove(gp+width, gp, (terminal.col - terminal.cursor.x - width) * sizeof(xelt_Glyph));
+
+	if (terminal.cursor.x+width > terminal.col) {
+		tnewline(1);
+		gp = &terminal.line[terminal.cursor.y][terminal.cursor.x];
+	}
+
+	tsetchar(u, &terminal.cursor.attr, terminal.cursor.x, terminal.cursor.y);
+
+	if (width == 2) {
+		gp->mode |= XELT_ATTR_WIDE;
+		if (terminal.cursor.x+1 < terminal.col) {
+			gp[1].u = '\0';
+			gp[1].mode = XELT_ATTR_WDUMMY;
+		}
+	}
+	if (terminal.cursor.x+width < terminal.col) {
+		tmoveto(terminal.cursor.x+width, terminal.cursor.y);
+	} else {
+		terminal.cursor.state |= XELT_CURSOR_WRAPNEXT;
+	}
+}
+
+void
+tresize(int col, int row)
+{
+	int i;
+	int minrow = MIN(row, terminal.row);
+	int mincol = MIN(col, terminal.col);
+	int *bp;
+	xelt_TCursor c;
+
+	if (col < 1 || row < 1) {
+		fprintf(stderr,
+		        "tresize: error resizing to %dx%d\n", col, row);
+		return;
+	}
+
+	/* rows move and get cut, the copied text stays */
+	selencode();
+
+	/* the lazy markers sit after the last column, fill before moving them */
+	for (i = 0; i < terminal.row; i++) {
+		tlinetouch(terminal.line[i]);
+		tlinetouch(terminal.alt[i]);
+	}
+
+	/*
+	 * slide screen to keep cursor where we expect it -
+	 * tscrollup would work here, but we can optimize to
+	 * memmove because we're freeing the earlier lines
+	 */
+	for (i = 0; i <= terminal.cursor.y - row; i++) {
+		free(terminal.line[i]);
+		free(terminal.alt[i]);
+	}
+	/* ensure that both src and dst are not NULL */
+	if (i > 0) {
+		memmove(terminal.line, terminal.line + i, row * sizeof(xelt_Line));
+		memmove(terminal.alt, terminal.alt + i, row * sizeof(xelt_Line));
+	}
+	for (i += row; i < terminal.row; i++) {
+		free(terminal.line[i]);
+		free(terminal.alt[i]);
+	}
+
+	/* evhandler_configure to new height */
+	terminal.line = xrealloc(terminal.line, row * sizeof(xelt_Line));
+	terminal.alt  = xrealloc(terminal.alt,  row * sizeof(xelt_Line));
+	terminal.dirty = xrealloc(terminal.dirty, row * sizeof(*terminal.dirty));
+	terminal.tabs = xrealloc(terminal.tabs, col * sizeof(*terminal.tabs));
+
+	/* evhandler_configure each row to new width, zero-pad if needed */
+	for (i = 0; i < minrow; i++) {
+		terminal.line[i] = xrealloc(terminal.line[i], (col + 1) * sizeof(xelt_Glyph));
+		terminal.alt[i]  = xrealloc(terminal.alt[i],  (col + 1) * sizeof(xelt_Glyph));
+	}
+
+	/* allocate any new rows */
+	for (/* i == minrow */; i < row; i++) {
+		terminal.line[i] = xmalloc((col + 1) * sizeof(xelt_Glyph));
+		terminal.alt[i] = xmalloc((col + 1) * sizeof(xelt_Glyph));
+	}
+	for (i = 0; i < row; i++) {
+		terminal.line[i][col].mode = 0;
+		terminal.line[i][col].u = 0;
+		terminal.alt[i][col].mode = 0;
+		terminal.alt[i][col].u = 0;
+	}
+	if (col > terminal.col) {
+		bp = terminal.tabs + terminal.col;
+
+		memset(bp, 0, sizeof(*terminal.tabs) * (col - terminal.col));
+		while (--bp > terminal.tabs && !*bp)
+			/* nothing */ ;
+		for (bp += tabspaces; bp < terminal.tabs + col; bp += tabspaces)
+			*bp = 1;
+	}
+	/* update terminal size */
+	terminal.col = col;
+	terminal.row = row;
+	/* reset scrolling region */
+	tsetscroll(0, row-1);
+	terminal.left = 0;
+	terminal.right = col-1;
+	/* make use of the LIMIT in tmoveto */
+	tmoveto(terminal.cursor.x, terminal.cursor.y);
+	/* Clearing both screens (it makes dirty all lines) */
+	c = terminal.cursor;
+	for (i = 0; i < 2; i++) {
+		if (mincol < col && 0 < minrow) {
+			tclearregion(mincol, 0, col - 1, minrow - 1);
+		}
+		if (0 < col && minrow < row) {
+			tclearregion(0, minrow, col - 1, row - 1);
+		}
+		tswapscreen();
+		tcursor(XELT_CURSOR_LOAD);
+	}
+	terminal.cursor = c;
+}
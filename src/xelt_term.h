@@ -0,0 +1,321 @@
+/* See LICENSE for license details. */
+
+/*
+ * Interface of the terminal emulation core (xelt_term.c), usable
+ * without any display.
+ */
+
+#ifndef XELT_TERM_H__
+#define XELT_TERM_H__
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "xelt_defines.h"
+#include "xelt_enums.h"
+
+typedef unsigned char xelt_uchar;
+typedef unsigned int xelt_uint;
+typedef unsigned long xelt_ulong;
+typedef unsigned short xelt_ushort;
+
+typedef uint_least32_t xelt_CharCode;
+
+typedef struct {
+	xelt_CharCode u;           /* character code */
+	xelt_ushort mode;      /* attribute flags */
+	xelt_ushort link;      /* OSC 8 hyperlink, see tlinkuri() */
+	uint32_t fg;      /* foreground  */
+	uint32_t bg;      /* background  */
+} xelt_Glyph;
+
+
+typedef xelt_Glyph *xelt_Line;
+
+
+typedef struct {
+	xelt_Glyph attr; /* current char attributes */
+	int x;
+	int y;
+	char state;
+} xelt_TCursor;
+
+
+/*
+ * Change of the cursor attributes an SGR makes, built while its
+ * parameters come in: mode = (mode & ~clear) | set.
+ */
+typedef struct {
+	xelt_ushort set;
+	xelt_ushort clear;
+	uint32_t fg, bg;
+	char setfg, setbg;
+	char unknown;          /* a parameter was not understood */
+	int last;              /* parameter a ':' sub-parameter belongs to */
+	char ext;              /* 38, 48 or 58 being read, 0 else */
+	char extcolon;         /* ... with ':' sub-parameters */
+	int nsub;              /* sub-parameters read after ext */
+	int sub[6];
+} xelt_SGRDelta;
+
+/* CSI Escape sequence structs */
+/* ESC '[' [[ [<priv>] <arg> [;]] <mode> [<mode>]] */
+typedef struct {
+	char buf[XELT_SIZE_ESC_BUF]; /* raw string */
+	int len;               /* raw string length */
+	char priv;
+	int arg[XELT_ESC_ARG_SIZ];
+	int narg;              /* nb of args */
+	char mode[2];
+	int cur;               /* parameter being read */
+	char colon;            /* cur follows a ':' */
+	char sub;              /* a ':' was read, only SGR takes them */
+	xelt_SGRDelta sgr;     /* the args read as an SGR */
+} xelt_CSIEscape;
+
+
+/* Sixel image being decoded, see tsixelput() */
+typedef struct {
+	uint32_t *pixels;      /* ARGB, 0 is transparent */
+	int width, height;     /* allocated */
+	int w, h;              /* drawn, or the raster attributes */
+	int x, y;              /* next sixel, y is the top of its band */
+	int color;             /* register drawn with */
+	int intro;             /* '#', '!' or '"' whose params are read */
+	int param[5];
+	int nparam;
+	int repeat;
+	uint32_t palette[XELT_SIZE_SIXEL_COLORS];
+} xelt_Sixel;
+
+/* Image of the core shown in cells, see timage() */
+typedef struct {
+	uint32_t id;           /* in the u of its cells */
+	int kind;              /* XELT_IMAGE_ARGB or XELT_IMAGE_PNG */
+	char *data;            /* pixels, w * h, or the PNG file */
+	size_t len;
+	int w, h;              /* pixels of the image */
+	int dw, dh;            /* pixels shown with cells of cw, ch */
+	int cw, ch;
+	int cols, rows;
+} xelt_Image;
+
+
+/* STR Escape sequence structs */
+/* ESC type [[ [<priv>] <arg> [;]] <mode>] ESC '\' */
+typedef struct {
+	char type;             /* ESC type ... */
+	char *buf;             /* raw string, grows up to strmax */
+	size_t len;            /* raw string length */
+	size_t size;           /* size of buf */
+	int over;              /* longer than strmax, dropped */
+	int sep[XELT_SIZE_STR_ARG - 1]; /* offsets of the ';' between args */
+	int nsep;
+	char *args[XELT_SIZE_STR_ARG];
+	int narg;              /* nb of args */
+	int osc52;             /* payload of OSC 52 being decoded, see tosc52put() */
+	char *data;            /* ... into data */
+	size_t datalen, datasize;
+	uint32_t bits;         /* base64 bits not decoded yet */
+	int nbits;
+	int image;             /* image being decoded, see timageput() */
+	xelt_Sixel *sixel;
+} xelt_STREscape;
+
+
+/* OSC 8 hyperlinks of a terminal, see tlinkid() */
+typedef struct {
+	char **str;            /* "params;URI" of id i, NULL when free */
+	int n;                 /* ids given so far, 0 is no link */
+	int *hash;             /* ids by hash of their string, 0 free */
+	int hashsize;          /* str and freeids have hashsize / 2 */
+	int *freeids;          /* ids no cell holds, freed by tlinksweep() */
+	int nfree;
+	size_t bytes;          /* of the strings, at most linkmax */
+} xelt_LinkTable;
+
+/* Internal representation of the screen */
+typedef struct {
+	int row;      /* nb row */
+	int col;      /* nb col */
+	xelt_Line *line;   /* screen */
+	xelt_Line *alt;    /* alternate screen */
+	int *dirty;  /* dirtyness of lines */
+	xelt_TCursor cursor;    /* cursor */
+	xelt_TCursor saved[2];  /* DECSC of the main and alt screens */
+	int top;      /* top    scroll limit */
+	int bot;      /* bottom scroll limit */
+	int left;     /* left margin, DECSLRM */
+	int right;    /* right margin */
+	int mode;     /* terminal mode flags */
+	int esc;      /* escape state flags */
+	char trantbl[4]; /* charset table translation */
+	int charset;  /* current charset */
+	int icharset; /* selected charset for sequence */
+	int numlock; /* lock numbers in keyboard */
+	int *tabs;
+	int cw, ch;   /* cell size in pixels, images are sized with it */
+	xelt_LinkTable links;
+	struct timespec synctime; /* start of the synchronized update */
+} xelt_Terminal;
+
+
+typedef struct {
+	int mode;
+	int type;
+	int snap;
+	/*
+	 * xelt_Selection variables:
+	 * nb – normalized coordinates of the beginning of the selection
+	 * ne – normalized coordinates of the end of the selection
+	 * ob – original coordinates of the beginning of the selection
+	 * oe – original coordinates of the end of the selection
+	 */
+	struct {
+		int x, y;
+	} nb, ne, ob, oe;
+
+	char *primary, *clipboard;
+	int lazy;              /* primary is this selection, see selencode() */
+	int alt;
+	struct timespec tclick1;
+	struct timespec tclick2;
+} xelt_Selection;
+
+
+/* Progress of getselread() through the selected text */
+typedef struct {
+	int y;                 /* row, counted from sel.nb.y */
+	int x;                 /* next column of the row, -1 before it */
+	int done;
+} xelt_SelReader;
+
+/*
+ * What the core asks from the front end. Every member may be NULL,
+ * the event is then dropped.
+ */
+typedef struct {
+	void (*settitle)(char *);                /* OSC 0, 1, 2 */
+	void (*resettitle)(void);                /* RIS */
+	int (*setcolorname)(int, const char *);  /* OSC 4, 104; 0 when set */
+	void (*loadcolors)(void);                /* RIS */
+	void (*bell)(void);
+	void (*draw)(void);                      /* every line is dirty */
+	void (*setpointermotion)(int);           /* mouse mode 1003 */
+	void (*setcursorstyle)(int);             /* DECSCUSR */
+	void (*ttyclosed)(void);                 /* read failed, NULL exits */
+	/* OSC 52, the selections ("c", "p" ...) and the malloc'ed text to own */
+	void (*setclipboard)(const char *, char *, size_t);
+	void (*getclipboard)(const char *);      /* answer with ttyosc52() */
+} xelt_TermCallbacks;
+
+/*
+ * One terminal moved out of the core globals, so that several can
+ * share them, see tsave() and tload().
+ */
+typedef struct {
+	xelt_Terminal terminal;
+	xelt_Selection sel;        /* primary, clipboard, lazy stay global */
+	xelt_CSIEscape csiescseq;
+	xelt_STREscape strescseq;
+	int cmdfd;
+	pid_t pid;
+	FILE *recfile;
+	char ttypend[XELT_SIZE_UTF]; /* incomplete UTF-8 of the last read */
+	int ttypendlen;
+} xelt_TermState;
+
+/*
+ * Hot path counters of the core, always on. Totals since the start,
+ * times in ms.
+ */
+typedef struct {
+	unsigned long bytes;       /* parsed by twrite() */
+	unsigned long csi;         /* sequences handled, by type */
+	unsigned long esc;
+	unsigned long osc;
+	unsigned long dcs;
+	unsigned long apc;         /* APC, PM and ESC k */
+	unsigned long scrolled;    /* lines scrolled */
+	unsigned long cells;       /* cells written */
+	unsigned long cleared;     /* cells cleared */
+	double readms;             /* in ttyread(), parsing included */
+	double parsems;            /* in twrite() */
+} xelt_TermStats;
+
+/* Sequence kind of the profiler, see tprofile() */
+typedef struct {
+	char name[16];             /* "CUP", "SGR 3", "OSC 52" ... */
+	unsigned long count;
+	unsigned long cells;       /* written or cleared */
+	double ms;
+} xelt_ProfEntry;
+
+/* State when a profiled sequence started */
+typedef struct {
+	double start;
+	unsigned long cells;
+} xelt_ProfMark;
+
+#include "xelt_macroses.h"
+
+extern xelt_Terminal terminal;
+extern xelt_Selection sel;
+extern xelt_TermStats termstats;
+
+/* config_term.h settings the front end needs too */
+extern char termname[];
+extern unsigned int defaultfg;
+extern unsigned int defaultbg;
+
+void printAndExit(const char *, ...);
+ssize_t xwrite(int, const char *, size_t);
+void *xmalloc(size_t);
+void *xrealloc(void *, size_t);
+char *xstrdup(char *);
+
+size_t utf8decode(char *, xelt_CharCode *, size_t);
+size_t utf8encode(xelt_CharCode, char *);
+
+int ttynew(char *, char *, char *, char **);
+size_t ttyread(void);
+void ttywrite1(const char *, size_t);
+void ttyresize(int, int);
+void ttyhangup(void);
+pid_t ttypid(void);
+int ttystatus(void);
+void ttysendbreak(void);
+void ttyosc52(const char *, const char *, size_t);
+void ttyrecord(char *);
+
+void tnew(int, int, const xelt_TermCallbacks *);
+void tfree(void);
+void tsave(xelt_TermState *);
+void tload(const xelt_TermState *);
+void tresize(int, int);
+void tputc(xelt_CharCode);
+size_t twrite(char *, size_t);
+long treplay(char *, int, void (*)(void));
+void tprofile(char *);
+void tsetdirt(int, int);
+void tlinetouch(xelt_Line);
+const char *tlinkuri(int);
+const xelt_Image *timage(uint32_t);
+void tfulldirt(void);
+void tdump(void);
+void tdumpsel(void);
+
+void selinit(void);
+void selnormalize(void);
+int selected(int, int);
+int selrow(int, int *, int *);
+char *getsel(void);
+size_t getselread(xelt_SelReader *, char *, size_t);
+void selencode(void);
+void selclear(void);
+
+#endif
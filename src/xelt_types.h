@@ -1,16 +1,18 @@
 #include <math.h>
-
-
-typedef unsigned char xelt_uchar;
-typedef unsigned int xelt_uint;
-typedef unsigned long xelt_ulong;
-typedef unsigned short xelt_ushort;
-
-typedef uint_least32_t xelt_CharCode;
+#include <pthread.h>
 
 // X11
 #include <X11/Xlib.h>
 #include <X11/Xft/Xft.h>
+#include <X11/extensions/XShm.h>
+
+/* Mouse buttons */
+enum {
+	XELT_MOUSSE_LEFT = Button1,
+	XELT_MOUSSE_MIDDLE = Button2,
+	XELT_MOUSSE_RIGHT = Button3,
+};
+
 typedef XftDraw *xelt_Draw;
 typedef struct {
 	Display *display;
@@ -18,6 +20,9 @@ typedef struct {
 	Window id;
 	Drawable drawbuf;
 	Atom xembed, wmdeletewin, netwmname, netwmpid, netwmstate, netwmfullscreen;
+	Atom netwmstateremove, clipboard, incr, targets;
+	Atom xtarget; /* selection target, UTF8_STRING or STRING */
+	Atom osc52;   /* property of the selections asked for with OSC 52 */
 	XIM inputmethod;
 	XIC inputcontext;
 	xelt_Draw draw;
@@ -31,6 +36,7 @@ typedef struct {
 	int width, height; /* window width and height */
 	int charheight; /* char height */
 	int charwidth; /* char width  */
+	int paney, panebottom; /* pixel rows of the loaded pane */
 	int depth; /* bit depth */
 	char state; /* evhandler_focus, redraw, visible */
 	int cursorstyle; 
@@ -51,69 +57,6 @@ typedef struct {
 
 typedef XftColor xelt_Color;
 
-typedef struct {
-	xelt_CharCode u;           /* character code */
-	xelt_ushort mode;      /* attribute flags */
-	uint32_t fg;      /* foreground  */
-	uint32_t bg;      /* background  */
-} xelt_Glyph;
-
-
-typedef xelt_Glyph *xelt_Line;
-
-
-typedef struct {
-	xelt_Glyph attr; /* current char attributes */
-	int x;
-	int y;
-	char state;
-} xelt_TCursor;
-
-
-/* CSI Escape sequence structs */
-/* ESC '[' [[ [<priv>] <arg> [;]] <mode> [<mode>]] */
-typedef struct {
-	char buf[XELT_SIZE_ESC_BUF]; /* raw string */
-	int len;               /* raw string length */
-	char priv;
-	int arg[XELT_ESC_ARG_SIZ];
-	int narg;              /* nb of args */
-	char mode[2];
-} xelt_CSIEscape;
-
-
-/* STR Escape sequence structs */
-/* ESC type [[ [<priv>] <arg> [;]] <mode>] ESC '\' */
-typedef struct {
-	char type;             /* ESC type ... */
-	char buf[XELT_SIZE_STR_BUF]; /* raw string */
-	int len;               /* raw string length */
-	char *args[XELT_SIZE_STR_ARG];
-	int narg;              /* nb of args */
-} xelt_STREscape;
-
-
-/* Internal representation of the screen */
-typedef struct {
-	int row;      /* nb row */
-	int col;      /* nb col */
-	xelt_Line *line;   /* screen */
-	xelt_Line *alt;    /* alternate screen */
-	int *dirty;  /* dirtyness of lines */
-	XftGlyphFontSpec *specbuf; /* font spec buffer used for rendering */
-	xelt_TCursor cursor;    /* cursor */
-	int top;      /* top    scroll limit */
-	int bot;      /* bottom scroll limit */
-	int mode;     /* terminal mode flags */
-	int esc;      /* escape state flags */
-	char trantbl[4]; /* charset table translation */
-	int charset;  /* current charset */
-	int icharset; /* selected charset for sequence */
-	int numlock; /* lock numbers in keyboard */
-	int *tabs;
-} xelt_Terminal;
-
-
 /* Purely graphic info */
 typedef struct {
 	xelt_uint b;
@@ -133,28 +76,6 @@ typedef struct {
 } xelt_Key;
 
 
-typedef struct {
-	int mode;
-	int type;
-	int snap;
-	/*
-	 * xelt_Selection variables:
-	 * nb – normalized coordinates of the beginning of the selection
-	 * ne – normalized coordinates of the end of the selection
-	 * ob – original coordinates of the beginning of the selection
-	 * oe – original coordinates of the end of the selection
-	 */
-	struct {
-		int x, y;
-	} nb, ne, ob, oe;
-
-	char *primary, *clipboard;
-	Atom xtarget;
-	int alt;
-	struct timespec tclick1;
-	struct timespec tclick2;
-} xelt_Selection;
-
 typedef union {
 	int i;
 	xelt_uint ui;
@@ -175,6 +96,215 @@ typedef struct {
 	xelt_CharCode unicodep;
 } xelt_Fontcache;
 
+/* Resolved glyph index, shared with the draw workers */
+typedef struct {
+	XftFont *font;         /* NULL for an empty slot */
+	FT_UInt glyph;
+	xelt_CharCode rune;
+	int flags;             /* XELT_FONTCACHE_* style */
+} xelt_GlyphIndex;
+
+/* Render cost counters, see xelt_stats.c */
+typedef struct {
+	unsigned long frames;
+	unsigned long rows;        /* rows redrawn */
+	int lastrows;              /* rows redrawn by the last frame */
+	unsigned long requests;    /* X requests issued by draw() */
+	int lastrequests;
+	unsigned long glyphmisses; /* runes missing from the glyph index */
+	unsigned long fontloads;   /* fallback fonts opened by fontconfig */
+	unsigned long colorallocs; /* colours allocated through Xft */
+	double drawms;             /* time in draw() */
+} xelt_RenderStats;
+
+/* Run of equally attributed glyphs, ready to be sent to the server */
+typedef struct {
+	xelt_Glyph base;
+	xelt_Color fg, bg;     /* resolved colours */
+	int x;                 /* first column */
+	int spec;              /* first spec of the run in the row */
+	int len;               /* number of specs */
+} xelt_DrawRun;
+
+/* Draw commands of one row, prepared by the draw workers */
+typedef struct {
+	XftGlyphFontSpec *specs;
+	xelt_DrawRun *runs;
+	int nruns;
+	int serial;            /* glyph missing in the index, draw serially */
+	int colorallocs;       /* for rstats, counted by the main thread */
+} xelt_RowPlan;
+
+/* Worker pool preparing full redraws (xelt_drawpool.c) */
+typedef struct {
+	int nthreads;          /* 0: prepare rows serially */
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	int generation;        /* bumped for every batch */
+	int pending;           /* workers still busy with the batch */
+	int *rows;             /* dirty rows of the batch */
+	int nrows;
+	int x1, x2, ena_sel;
+	xelt_RowPlan *plans;   /* indexed by row */
+	int planrows, plancols;
+} xelt_DrawPool;
+
+/* Rasterized glyph of the MIT-SHM renderer (xelt_shm.c) */
+typedef struct {
+	XftFont *font;         /* NULL for an empty cache slot */
+	FT_UInt glyph;
+	int width, height;     /* bitmap size */
+	int left, top;         /* bearing relative to the pen position */
+	xelt_uchar *alpha;     /* coverage, width * height bytes */
+} xelt_GlyphBitmap;
+
+/* Shared segment of the MIT-SHM renderer */
+typedef struct {
+	XImage *image;
+	XShmSegmentInfo info;
+	unsigned long serial;  /* of its last XShmPutImage, 0 for none */
+} xelt_ShmSegment;
+
+/*
+ * Client side frame buffer of the MIT-SHM renderer, double buffered:
+ * a frame is drawn into one segment while the server reads the other.
+ */
+typedef struct {
+	int active;            /* 0: draw through Xft */
+	XImage *image;         /* drawn into, of seg[cur] */
+	xelt_ShmSegment seg[2];
+	int cur;
+	char *damage;          /* damaged pixel rows of image */
+	xelt_GlyphBitmap *cache;
+	int cachelen;          /* used slots in cache */
+} xelt_ShmImage;
+
+/* Terminal shown in a part of the window (xelt_panes.c) */
+typedef struct {
+	xelt_TermState state;  /* saved while another pane is loaded */
+	int fd;                /* its tty */
+	int y;                 /* first row in the window */
+	int row;               /* rows, the width is the window's */
+	int closed;            /* the tty was hung up */
+	char osc52;            /* selection asked for with OSC 52, 'p' or 'c' */
+} xelt_Pane;
+
+/* Panes stacked in the window, or one at a time in tabs mode */
+typedef struct {
+	xelt_Pane *list;
+	int n;
+	int cur;               /* has the keyboard focus */
+	int loaded;            /* in the core globals, -1 for none */
+	int tabs;              /* cur alone fills the window */
+	int sepdirty;          /* separators to be drawn again */
+	char *dir;             /* where the shells start, NULL for ours */
+} xelt_Panes;
+
+/* Selection served in chunks to a requestor, ICCCM INCR */
+typedef struct {
+	Window requestor;
+	Atom property, target;
+	char *data;            /* copy, the selection may change meanwhile */
+	size_t len, ofs;       /* sent up to ofs */
+	xelt_SelReader reader; /* without data, the lazy primary selection */
+} xelt_Incr;
+
+/* A screen row as searched */
+typedef struct {
+	char *text;            /* folded UTF-8 */
+	int *col;              /* column of each byte of text */
+	int len;
+	int *match;            /* first and last column of each match */
+	int nmatch;
+	int valid;             /* up to date with the row and the query */
+} xelt_SearchRow;
+
+/* Incremental search of the focused pane (xelt_search.c) */
+typedef struct {
+	int active;
+	int drawing;           /* the rows being drawn are the searched ones */
+	char query[XELT_SIZE_SEARCH]; /* folded UTF-8 */
+	int qlen;
+	xelt_SearchRow *rows;
+	int nrows, ncols;
+	xelt_Line *screen;     /* terminal.line the rows were read from */
+	int cury, curi;        /* current match, cury -1 for none */
+} xelt_Search;
+
+/* Links found on a row of the focused pane */
+typedef struct {
+	int *span;             /* first and last column and kind of each */
+	int nspan;
+	int valid;             /* up to date with the row */
+} xelt_LinkRow;
+
+/* Links of the focused pane and the one under the pointer (xelt_links.c) */
+typedef struct {
+	int drawing;           /* the rows being drawn are the indexed ones */
+	xelt_LinkRow *rows;
+	int nrows, ncols;
+	xelt_Line *screen;     /* terminal.line the rows were read from */
+	char *text;            /* the row being read, a byte per column */
+	int hovery;            /* row of the found link under the pointer, -1 for none */
+	int hoverx1, hoverx2;
+	int hoverid;           /* OSC 8 link under the pointer, 0 for none */
+} xelt_Links;
+
+/* Image of the core uploaded to the server (xelt_images.c) */
+typedef struct {
+	uint32_t id;           /* see timage() */
+	Pixmap pixmap;         /* ARGB, the pixels of the image */
+	Picture pict;          /* ... scaled to the cells */
+	int cw, ch;            /* cell size of the scale */
+	size_t bytes;
+	unsigned long used;    /* ximageflush() it was last drawn by */
+} xelt_ImageEntry;
+
+/* Cells of an image to composite, in pixels */
+typedef struct {
+	uint32_t id;
+	int sx, sy;            /* in the image scaled to the cells */
+	int dx, dy, w, h;      /* on the back buffer */
+} xelt_ImageDraw;
+
+/* Images of every window uploaded, and the cells to draw (xelt_images.c) */
+typedef struct {
+	xelt_ImageEntry *list;
+	int n;
+	size_t bytes;          /* of the pixmaps, at most imagecachemax */
+	unsigned long clock;
+	xelt_ImageDraw *queue; /* since the last ximageflush() */
+	int nqueue, queuesize;
+} xelt_Images;
+
+/* A window of xelt -d with its panes, see xframeload() */
+typedef struct {
+	xelt_Window win;
+	xelt_Panes panes;
+	xelt_ShmImage shm;
+	xelt_Search search;
+	xelt_Links links;
+} xelt_Frame;
+
+/* Client of xelt -d whose message is being read, see xdaemonread() */
+typedef struct {
+	int fd;
+	char buf[XELT_SIZE_DAEMON_MSG];
+	size_t len;
+	struct timespec start; /* of the connection */
+} xelt_Client;
+
+/* Windows served by the process, one unless it is a daemon */
+typedef struct {
+	xelt_Frame *list;
+	int n;
+	int cur;               /* in xelt_windowmain, panes and shmimg, -1 for none */
+	int sock;              /* listening socket of xelt -d, -1 else */
+	xelt_Client *clients;
+	int nclients;
+} xelt_Frames;
+
 /* 
 for reference only
 typedef struct {